@@ -0,0 +1,66 @@
+#!/bin/sh
+# baseline.sh: layout benchmark across revisions
+#
+# Builds bench/layout.c against looseleaf.h as of each git revision given, and
+# then against the working tree, and runs each build. With no revisions, it
+# compares the header before and after nodes were packed into a tag array and
+# per-kind payloads (bedc259), which is the before/after of that change.
+# Headers older than LL_NO_EXAMPLE have their example cut off, and headers
+# older than ll_memory_stats get one that counts their node storage the way
+# layout.c does.
+#
+#   sh bench/baseline.sh [revision...]
+
+set -e
+cd "$(git rev-parse --show-toplevel)"
+[ $# -gt 0 ] || set -- bedc259^ bedc259
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Write the header of revision $1 (or the working tree, for "") to $2
+header() {
+  if [ -z "$1" ]; then
+    cat src/looseleaf.h >"$2"
+    return
+  fi
+  if git show "$1:src/looseleaf.h" | grep -q LL_NO_EXAMPLE; then
+    git show "$1:src/looseleaf.h" >"$2"
+  else
+    git show "$1:src/looseleaf.h" | sed '/^\/\/ EXAMPLE =/,$d' >"$2"
+  fi
+  grep -q ll_memory_stats "$2" && return
+  cat >>"$2" <<'EOF'
+typedef struct {
+  uint32_t nodes;
+  uint32_t payload_bytes;
+} ll_MemoryStats;
+EOF
+  if grep -q 'll__Node\* internalArray' "$2"; then
+    # one whole ll__Node per node, which layout.c takes for a tag, an offset
+    # and a payload
+    cat >>"$2" <<'EOF'
+ll_MemoryStats ll_memory_stats(const ll_Context* ctx) {
+  uint32_t length = ctx->nodes.length;
+  return (ll_MemoryStats){length, length * (uint32_t)(sizeof(ll__Node) - sizeof(uint8_t) - sizeof(uint32_t))};
+}
+EOF
+  else
+    cat >>"$2" <<'EOF'
+ll_MemoryStats ll_memory_stats(const ll_Context* ctx) {
+  return (ll_MemoryStats){ctx->nodes.length, ctx->nodes.payload_length};
+}
+EOF
+  fi
+}
+
+for revision in "$@" ""; do
+  dir="$work/$(printf '%s' "${revision:-current}" | tr -c 'A-Za-z0-9\n' _)"
+  mkdir -p "$dir/src" "$dir/bench"
+  header "$revision" "$dir/src/looseleaf.h"
+  cp bench/layout.c "$dir/bench/layout.c"
+  $CC $CFLAGS -o "$dir/layout" "$dir/bench/layout.c"
+  echo "${revision:-working tree}:"
+  "$dir/layout"
+done
@@ -0,0 +1,58 @@
+// generations.c: stale handle check
+//
+// Keeps a handle from the first frame and hands it to ll_gen_commands, under a
+// fresh parent, in each of the frames that follow, until its generation comes
+// around again (see LL_HANDLE_INDEX_BITS). Every frame before that must refuse
+// it, and the frame where it comes around must take it for the node of that
+// frame; it exits with 1 otherwise. Build with -DLL_HANDLE_INDEX_BITS=N to
+// check another split.
+//
+//   cc -O2 -o generations bench/generations.c && ./generations
+
+#define _POSIX_C_SOURCE 199309L
+#define LL_NO_EXAMPLE
+#include "../src/looseleaf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+ll_Size measure_text(const char* text, uint16_t letter_spacing) {
+  return (ll_Size){.width = (uint32_t)strlen(text) * (6 + letter_spacing), .height = 8};
+}
+
+ll_Size measure_image(LL_IMAGE_TYPE* image) {
+  (void)image;
+  return (ll_Size){.width = 16, .height = 16};
+}
+
+int main(void) {
+  ll_set_text_measurement_fn(measure_text);
+  ll_set_image_measurement_fn(measure_image);
+  ll_configure_max_nodes(16);
+  uint64_t size = ll_min_arena_size();
+  char* arena = malloc(size);
+  ll_Context* ctx = ll_init(arena, size);
+  if (ctx == NULL) return 1;
+
+  ll_begin(ctx);
+  ll_NodeHandle kept = ll_text((ll_TextConfig){0}, "kept");
+  if (ll_gen_commands(kept).length != 1) return 1;
+
+  // the generation skips zero, which no handle has
+  uint32_t period = (UINT32_C(1) << (32 - LL_HANDLE_INDEX_BITS)) - 1;
+  int failures = 0;
+  for (uint32_t frame = 1; frame <= period; frame++) {
+    ll_begin(ctx);
+    ll_NodeHandle text = ll_text((ll_TextConfig){0}, "new");
+    ll_RenderCommandArray cmds = ll_gen_commands(ll_above((ll_AboveConfig){0}, text, kept));
+    bool taken = cmds.internalArray != NULL;
+    if (taken != (frame == period)) {
+      printf("frame %u: the handle from frame 0 was %s\n", frame, taken ? "taken" : "refused");
+      failures++;
+    }
+  }
+  printf("%u index bits: handles come around after %u frames; %d frames wrong\n", LL_HANDLE_INDEX_BITS, period,
+         failures);
+  free(arena);
+  return failures > 0;
+}
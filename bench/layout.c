@@ -0,0 +1,88 @@
+// layout.c: node storage and layout benchmark
+//
+// Builds a balanced tree of about 160,000 mixed leaves and combinators, then
+// reports how many bytes each node takes up and how long ll_gen_commands takes
+// to lay it out and generate its render commands. bench/baseline.sh runs it
+// against older revisions of the header too.
+//
+//   cc -O2 -o layout bench/layout.c && ./layout
+
+#define _POSIX_C_SOURCE 199309L
+#define LL_NO_EXAMPLE
+#include "../src/looseleaf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LEAF_COUNT 75000
+#define RUNS 50
+
+static const char* words[] = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta"};
+
+ll_Size measure_text(const char* text, uint16_t letter_spacing) {
+  return (ll_Size){.width = (uint32_t)strlen(text) * (6 + letter_spacing), .height = 8};
+}
+
+ll_Size measure_image(LL_IMAGE_TYPE* image) {
+  (void)image;
+  return (ll_Size){.width = 16, .height = 16};
+}
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Build a balanced tree over leaves [first, first + count)
+ll_NodeHandle build(uint32_t first, uint32_t count) {
+  if (count == 1) {
+    switch (first % 4) {
+    case 0: return ll_image((void*)(uintptr_t)(first % 3 + 1), (ll_Size){0, 0});
+    case 1: return ll_empty();
+    default: return ll_text((ll_TextConfig){.letter_spacing = first % 2}, words[first % 6]);
+    }
+  }
+  ll_NodeHandle a = build(first, count / 2);
+  ll_NodeHandle b = build(first + count / 2, count - count / 2);
+  switch (count % 5) {
+  case 0: return ll_above((ll_AboveConfig){.align_h = LL_HORIZ_ALIGN_CENTER}, a, b);
+  case 1: return ll_beside((ll_BesideConfig){.align_v = LL_VERT_ALIGN_BOTTOM}, a, b);
+  case 2: return ll_overlay((ll_OverlayConfig){.offset = {1, 2}}, a, b);
+  case 3: return ll_move_pinhole((ll_MovePinholeConfig){{2, -1}}, ll_above((ll_AboveConfig){0}, a, b));
+  default: return ll_reset_pinhole(ll_beside((ll_BesideConfig){0}, a, b));
+  }
+}
+
+int main(void) {
+  ll_set_text_measurement_fn(measure_text);
+  ll_set_image_measurement_fn(measure_image);
+  ll_configure_max_nodes(3 * LEAF_COUNT);
+  uint64_t size = ll_min_arena_size();
+  char* arena = malloc(size);
+  ll_Context* ctx = ll_init(arena, size);
+  if (ctx == NULL) return 1;
+
+  double best = 1e9;
+  uint32_t command_count = 0;
+  for (int run = 0; run < RUNS; run++) {
+    ll_begin(ctx);
+    ll_NodeHandle root = build(0, LEAF_COUNT);
+    double start = now();
+    ll_RenderCommandArray cmds = ll_gen_commands(root);
+    double elapsed = now() - start;
+    if (elapsed < best) best = elapsed;
+    command_count = cmds.length;
+  }
+
+  // each node has a one-byte tag and a payload offset, plus its payload
+  ll_MemoryStats stats = ll_memory_stats(ctx);
+  double bytes = (sizeof(uint8_t) + sizeof(uint32_t)) * (double)stats.nodes + stats.payload_bytes;
+  printf("%u nodes, %u commands\n", stats.nodes, command_count);
+  printf("%.2f bytes/node, %.2f ms (%.1f ns/node), best of %d\n", bytes / stats.nodes, best * 1e3,
+         best * 1e9 / stats.nodes, RUNS);
+  free(arena);
+  return 0;
+}
@@ -0,0 +1,137 @@
+// soft_text.c: text-run cache benchmark for the software backend
+//
+// Draws a frame of about 450 text commands with and without the text-run cache
+// (see ll_soft_set_text_cache), in both framebuffer formats, opaque and
+// translucent, and reports the time per frame. Every letter spacing is also
+// checked to draw exactly the same pixels both ways, including negative
+// spacings, whose glyphs overlap, and so are glyph offsets from
+// ll_set_glyph_measurement_fn; it exits with 1 if any differ.
+//
+//   cc -O2 -o soft_text bench/soft_text.c && ./soft_text
+
+#define _POSIX_C_SOURCE 199309L
+#define LL_NO_EXAMPLE
+#include "../src/looseleaf.h"
+#include "../src/looseleaf_soft.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 1024
+#define HEIGHT 768
+#define RUNS 50
+
+static const char* words[] = {"alpha beta", "Hello, world!", "Settings", "a much longer line of text here",
+                              "0123456789", "Cancel"};
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Measure glyphs for ll_set_glyph_measurement_fn in a font with wider m and
+// w, or squeezed together with an odd `letter_spacing`
+ll_Size measure_glyphs(const char* text, uint16_t letter_spacing, int32_t* glyph_x) {
+  int32_t x = 0;
+  for (uint32_t i = 0; text[i] != '\0'; i++) {
+    if (glyph_x != NULL) glyph_x[i] = x;
+    x += (letter_spacing % 2 ? 4 : 6) + (text[i] == 'm' || text[i] == 'w' ? 3 : 0);
+  }
+  return (ll_Size){.width = (uint32_t)x, .height = LL_SOFT_GLYPH_HEIGHT};
+}
+
+// Lay out five columns of 90 lines of text, with `letter_spacing`
+ll_RenderCommandArray gen_frame(ll_Context* ctx, int16_t letter_spacing) {
+  ll_begin(ctx);
+  ll_NodeHandle columns = ll_empty();
+  for (int x = 0; x < 5; x++) {
+    ll_NodeHandle column = ll_empty();
+    for (int y = 0; y < 90; y++) {
+      ll_NodeHandle line = ll_text((ll_TextConfig){.letter_spacing = letter_spacing}, words[(x * 7 + y) % 6]);
+      column = ll_above((ll_AboveConfig){0}, column, line);
+    }
+    columns = ll_beside((ll_BesideConfig){0}, columns, column);
+  }
+  return ll_gen_commands(columns);
+}
+
+// Draw `cmds` into `fb` over a fixed background
+void draw(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, uint32_t color) {
+  ll_soft_clear(fb, LL_SOFT_RGBA(10, 20, 30, 255));
+  ll_soft_render(fb, cmds, color);
+}
+
+int main(void) {
+  ll_set_text_measurement_fn(ll_soft_measure_text);
+  ll_set_image_measurement_fn(ll_soft_measure_image);
+  ll_configure_max_nodes(2048);
+  // glyph offsets take up more of the arena
+  ll_set_glyph_measurement_fn(measure_glyphs);
+  uint64_t size = ll_min_arena_size();
+  ll_set_glyph_measurement_fn(NULL);
+  char* arena = malloc(size);
+  ll_Context* ctx = ll_init(arena, size);
+  ll_Size atlas_size = {1024, 256};
+  uint64_t cache_size = ll_soft_text_cache_size(atlas_size, 1000);
+  char* cache_mem = malloc(cache_size);
+  ll_SoftTextCache* cache = ll_soft_text_cache_init(cache_mem, cache_size, atlas_size, 1000);
+  char* plain = malloc((size_t)WIDTH * HEIGHT * 4);
+  char* cached = malloc((size_t)WIDTH * HEIGHT * 4);
+  if (ctx == NULL || cache == NULL || plain == NULL || cached == NULL) return 1;
+
+  int failures = 0;
+  const int16_t spacings[] = {0, 1, -1, -2, -4};
+  for (int format = 0; format < 2; format++) {
+    uint32_t stride = format == LL_SOFT_FORMAT_RGB565 ? WIDTH * 2 : WIDTH * 4;
+    ll_SoftFramebuffer a = {plain, WIDTH, HEIGHT, stride, format};
+    ll_SoftFramebuffer b = {cached, WIDTH, HEIGHT, stride, format};
+    for (int opaque = 0; opaque < 2; opaque++) {
+      uint32_t color = LL_SOFT_RGBA(200, 220, 255, opaque ? 255 : 160);
+      for (size_t i = 0; i < sizeof(spacings) / sizeof(*spacings); i++) {
+        ll_RenderCommandArray cmds = gen_frame(ctx, spacings[i]);
+        ll_soft_set_text_cache(NULL);
+        draw(&a, cmds, color);
+        ll_soft_set_text_cache(cache);
+        draw(&b, cmds, color);
+        if (memcmp(plain, cached, (size_t)HEIGHT * stride) != 0) {
+          printf("format %d, alpha %d, spacing %d: cached text differs\n", format, opaque ? 255 : 160, spacings[i]);
+          failures++;
+        }
+      }
+      ll_set_glyph_measurement_fn(measure_glyphs);
+      for (int16_t spacing = 0; spacing < 2; spacing++) {
+        ll_RenderCommandArray cmds = gen_frame(ctx, spacing);
+        ll_soft_set_text_cache(NULL);
+        draw(&a, cmds, color);
+        ll_soft_set_text_cache(cache);
+        draw(&b, cmds, color);
+        if (memcmp(plain, cached, (size_t)HEIGHT * stride) != 0) {
+          printf("format %d, alpha %d, glyph offsets %d: cached text differs\n", format, opaque ? 255 : 160, spacing);
+          failures++;
+        }
+      }
+      ll_set_glyph_measurement_fn(NULL);
+
+      ll_RenderCommandArray cmds = gen_frame(ctx, 0);
+      for (int use_cache = 0; use_cache < 2; use_cache++) {
+        ll_soft_set_text_cache(use_cache ? cache : NULL);
+        draw(&a, cmds, color);
+        double start = now();
+        for (int run = 0; run < RUNS; run++) ll_soft_render(&a, cmds, color);
+        printf("%s, alpha %3d, %-6s: %.3f ms/frame (%u commands)\n",
+               format == LL_SOFT_FORMAT_RGB565 ? "rgb565  " : "rgba8888", opaque ? 255 : 160,
+               use_cache ? "cached" : "plain", (now() - start) / RUNS * 1e3, cmds.length);
+      }
+    }
+  }
+  ll_CacheStats stats = ll_soft_text_cache_stats(cache);
+  printf("cache: %llu hits, %llu misses, %llu evictions\n", (unsigned long long)stats.hits,
+         (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+  free(cached);
+  free(plain);
+  free(cache_mem);
+  free(arena);
+  return failures > 0;
+}
@@ -0,0 +1,176 @@
+// subtree_cache.c: subtree cache equivalence check
+//
+// Generates frames of random trees that change a little from one frame to the
+// next with and without the subtree cache (see ll_enable_subtree_cache), and
+// checks that both draw exactly the same render commands, with the right text
+// hashes, including under clips and through a moving viewport, which cull
+// spliced subtrees. It starts with pairs of different subtrees that once
+// shared a structural hash. It exits with 1 if any frame differs.
+//
+//   cc -O2 -o subtree_cache bench/subtree_cache.c && ./subtree_cache
+
+#define _POSIX_C_SOURCE 199309L
+#define LL_NO_EXAMPLE
+#include "../src/looseleaf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FRAMES 400
+#define MAX_NODES 20000
+
+static const char* words[] = {"a", "bb", "ccc", "dddd", "eeeee", "f"};
+static unsigned seed;
+
+ll_Size measure_text(const char* text, uint16_t letter_spacing) {
+  return (ll_Size){.width = (uint32_t)strlen(text) * (6 + letter_spacing), .height = 8};
+}
+
+ll_Size measure_image(LL_IMAGE_TYPE* image) {
+  return (ll_Size){.width = 4 + (uint32_t)(uintptr_t)image % 16, .height = 16};
+}
+
+unsigned next(void) {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 16 & 0x7fff;
+}
+
+// Build a random tree of up to `depth` levels. Most of it is the same for the
+// same seed, but some leaves and offsets depend on `frame`.
+ll_NodeHandle build(int depth, unsigned frame) {
+  unsigned kind = next() % 10;
+  if (depth == 0 || kind < 2) {
+    if (next() % 7 == 0) return ll_empty();
+    if (next() % 3 == 0) return ll_image((void*)(uintptr_t)(0x1000 + next() % 3 * 16), (ll_Size){0, 0});
+    unsigned word = next() % 6;
+    if (next() % 50 == 0) word = (word + frame) % 6;
+    return ll_text((ll_TextConfig){.letter_spacing = (int16_t)(next() % 2)}, words[word]);
+  }
+  if (kind == 3) {
+    ll_Vec2 offset = {(int32_t)(next() % 5) - 2, (int32_t)(next() % 5) - 2};
+    return ll_move_pinhole((ll_MovePinholeConfig){offset}, build(depth - 1, frame));
+  }
+  if (kind == 4) {
+    switch (next() % 3) {
+    case 0: return ll_reset_pinhole(build(depth - 1, frame));
+    case 1: return ll_key(next() % 3 + (frame % 7 == 0) + (uint64_t)depth * 10, build(depth - 1, frame));
+    default: {
+      // scrolls a little every frame
+      ll_Size size = {next() % 30, next() % 20};
+      ll_Vec2 offset = {(int32_t)(next() % 9) - 6, (int32_t)(next() % 9) - 6 - (int32_t)(frame % 4)};
+      return ll_clip((ll_ClipConfig){size, offset}, build(depth - 1, frame));
+    }
+    }
+  }
+  if (kind == 5) {
+    ll_NodeHandle children[4];
+    uint32_t count = 2 + next() % 3;
+    for (uint32_t i = 0; i < count; i++) children[i] = build(depth - 1, frame);
+    if (next() % 2) return ll_above_n((ll_AboveConfig){next() % 3, {0, (int32_t)(frame % 2)}}, children, count);
+    return ll_beside_n((ll_BesideConfig){next() % 3, {(int32_t)(frame % 2), 0}}, children, count);
+  }
+  ll_NodeHandle a = build(depth - 1, frame);
+  ll_NodeHandle b = build(depth - 1, frame);
+  int32_t offset = next() % 9 == 0 ? (int32_t)(frame % 3) : 0;
+  if (kind < 8) return ll_above((ll_AboveConfig){next() % 3, {offset, 0}}, a, b);
+  if (kind < 9) return ll_beside((ll_BesideConfig){next() % 3, {0, offset}}, a, b);
+  return ll_overlay((ll_OverlayConfig){next() % 3, next() % 3, {offset, 1}}, a, b);
+}
+
+bool same_command(const ll_RenderCommand* a, const ll_RenderCommand* b) {
+  if (a->tag != b->tag || a->key != b->key || a->bounds.posn.x != b->bounds.posn.x ||
+      a->bounds.posn.y != b->bounds.posn.y || a->bounds.size.width != b->bounds.size.width ||
+      a->bounds.size.height != b->bounds.size.height) {
+    return false;
+  }
+  if (a->tag == LL_RENDER_DATA_TAG_IMAGE) {
+    return a->render_data.image_render_data.imageData == b->render_data.image_render_data.imageData;
+  }
+  if (a->tag == LL_RENDER_DATA_TAG_TEXT) {
+    const ll_TextRenderData* text = &a->render_data.text_render_data;
+    return text->text == b->render_data.text_render_data.text &&
+           text->letter_spacing == b->render_data.text_render_data.letter_spacing &&
+           text->text_hash == b->render_data.text_render_data.text_hash &&
+           text->text_hash == ll__text_key(text->text, (uint16_t)text->letter_spacing);
+  }
+  return true;
+}
+
+bool same_commands(ll_RenderCommandArray a, ll_RenderCommandArray b) {
+  if (a.length != b.length) return false;
+  for (uint32_t i = 0; i < a.length; i++) {
+    if (!same_command(&a.internalArray[i], &b.internalArray[i])) return false;
+  }
+  return true;
+}
+
+// Two frames of different subtrees whose hashes used to collide
+typedef ll_NodeHandle (*Builder)(int frame);
+
+ll_NodeHandle key_or_move(int frame) {
+  ll_NodeHandle image = ll_image((void*)(uintptr_t)0x1000, (ll_Size){0, 0});
+  return frame == 0 ? ll_key(1, image) : ll_move_pinhole((ll_MovePinholeConfig){{15, 0}}, image);
+}
+
+ll_NodeHandle beside_or_above(int frame) {
+  ll_NodeHandle leaves[] = {ll_image((void*)(uintptr_t)0x1000, (ll_Size){0, 0}), ll_text((ll_TextConfig){0}, "hi")};
+  if (frame == 0) return ll_beside_n((ll_BesideConfig){.align_v = LL_VERT_ALIGN_TOP}, leaves, 2);
+  return ll_above_n((ll_AboveConfig){.align_h = LL_HORIZ_ALIGN_CENTER}, leaves, 2);
+}
+
+int main(void) {
+  ll_set_text_measurement_fn(measure_text);
+  ll_set_image_measurement_fn(measure_image);
+  ll_configure_max_nodes(MAX_NODES);
+  uint32_t capacity = 4096;
+  uint64_t size = ll_min_arena_size() + ll_subtree_cache_arena_size(capacity) + ll_text_hashes_arena_size();
+  char* cached_arena = malloc(size);
+  char* plain_arena = malloc(size);
+  ll_Context* cached = ll_init(cached_arena, size);
+  ll_Context* plain = ll_init(plain_arena, size);
+  if (cached == NULL || plain == NULL || !ll_enable_subtree_cache(cached, capacity)) return 1;
+  ll_enable_text_hashes(cached);
+  ll_enable_text_hashes(plain);
+
+  int failures = 0;
+  const Builder pairs[] = {key_or_move, beside_or_above};
+  for (size_t i = 0; i < sizeof(pairs) / sizeof(*pairs); i++) {
+    ll_invalidate_subtrees(cached);
+    for (int frame = 0; frame < 2; frame++) {
+      ll_begin(cached);
+      ll_RenderCommandArray a = ll_gen_commands(pairs[i](frame));
+      ll_begin(plain);
+      ll_RenderCommandArray b = ll_gen_commands(pairs[i](frame));
+      if (!same_commands(a, b)) {
+        printf("collision pair %zu, frame %d: cached commands differ\n", i, frame);
+        failures++;
+      }
+    }
+  }
+
+  ll_invalidate_subtrees(cached);
+  for (unsigned frame = 0; frame < FRAMES; frame++) {
+    ll_Context* contexts[] = {cached, plain};
+    ll_RenderCommandArray cmds[2];
+    for (int i = 0; i < 2; i++) {
+      ll_begin(contexts[i]);
+      // a new tree every ten frames
+      seed = 1234 + frame / 10;
+      ll_NodeHandle root = build(9, frame);
+      // every other tree is drawn through a viewport that moves every frame
+      ll_Bounds viewport = {{(int32_t)(frame % 10) * 7 - 20, (int32_t)(frame % 10) * 5 - 10}, {60, 45}};
+      cmds[i] = frame / 10 % 2 ? ll_gen_commands_clipped(root, viewport) : ll_gen_commands(root);
+    }
+    if (!same_commands(cmds[0], cmds[1])) {
+      printf("frame %u: cached commands differ\n", frame);
+      failures++;
+    }
+  }
+
+  ll_CacheStats stats = ll_subtree_cache_stats(cached);
+  printf("%d of %d frames differ; %llu hits, %llu misses, %llu evictions\n", failures, FRAMES + 4,
+         (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+  free(plain_arena);
+  free(cached_arena);
+  return failures > 0;
+}
@@ -3,6 +3,10 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#ifndef __STDC_NO_ATOMICS__
+#include <stdatomic.h>
+#endif
 
 //    +----------+
 //   /  HEADER  /
@@ -13,6 +17,17 @@
 #define LL_IMAGE_TYPE void
 #endif
 
+// The storage class of the current context and the configured maximum node
+// count, which are per thread so that each thread can record into its own
+// context. Define this as empty to share them between threads instead.
+#ifndef LL_THREAD_LOCAL
+#ifdef __STDC_NO_THREADS__
+#define LL_THREAD_LOCAL
+#else
+#define LL_THREAD_LOCAL _Thread_local
+#endif
+#endif
+
 // initialization stage ========================================================
 // --> create the memory arena and context
 
@@ -46,8 +61,27 @@ typedef struct {
 
 // types of nodes --------------------------------------------------------------
 
+// An opaque reference to a node. The low LL_HANDLE_INDEX_BITS bits hold the
+// node's index, and the remaining high bits hold the generation of the
+// context (see ll_begin) that the node was created in.
 typedef uint32_t ll_NodeHandle;
 
+// The number of handle bits that hold the node index, which bounds
+// ll_configure_max_nodes. The generation gets the rest, so it comes around
+// again after 2^(32 - LL_HANDLE_INDEX_BITS) - 1 frames (1023 by default), and
+// a handle kept that long is taken for a node of the current frame. Define
+// this lower, before including looseleaf.h, for more generations and fewer
+// nodes.
+#ifndef LL_HANDLE_INDEX_BITS
+#define LL_HANDLE_INDEX_BITS 22
+#endif
+#if LL_HANDLE_INDEX_BITS < 8 || LL_HANDLE_INDEX_BITS > 30
+#error "LL_HANDLE_INDEX_BITS must be between 8 and 30"
+#endif
+
+// The unit of every combinator: a leaf with no size that draws nothing
+#define LL_EMPTY_LEAF ll_empty()
+
 // HACK no support for newlines as of now
 typedef struct {
   // Additional spacing between letters (can be negative)
@@ -74,69 +108,162 @@ typedef struct {
   ll_Vec2 offset;
 } ll_MovePinholeConfig;
 
-// the node struct -------------------------------------------------------------
+typedef struct {
+  // the size of the visible region
+  ll_Size size;
+  // where the child's pinhole goes, relative to the region's top-left corner;
+  // scroll by making this negative
+  ll_Vec2 offset;
+} ll_ClipConfig;
 
-typedef struct ll__Node {
-  // A union describing the contents (image, text, or children) of a node.
-  union Contents {
-    // The data of this node, if it is an image node
-    struct ImageData {
-      LL_IMAGE_TYPE* image_data;
-      ll_Size image_size;
-    };
-    // The text contents of this node, if it is a text node
-    const char* text_data;
-    // the single child of this node, if it is a transformation
-    ll_NodeHandle child;
-    // the two children of this node, if it is a combinator
-    struct Children {
-      // The first child of this node, if one exists
-      ll_NodeHandle first_child;
-      // The second child of this node, if one exists
-      ll_NodeHandle second_child;
-    } children;
-  } data;
-
-  // A union describing the optional configuration of a node.
-  union Config {
-    ll_TextConfig text_config;
-    ll_AboveConfig above_config;
-    ll_BesideConfig beside_config;
-    ll_OverlayConfig overlay_config;
-    ll_MovePinholeConfig move_pinhole_config;
-  } config;
-
-  // TODO consolidate the two unions above into one?
-
-  // An enum describing a node's type.
-  enum Tag {
-    LL__NODE_TYPE_IMAGE,
-    LL__NODE_TYPE_TEXT,
-    LL__NODE_TYPE_ABOVE,
-    LL__NODE_TYPE_BESIDE,
-    LL__NODE_TYPE_OVERLAY,
-    LL__NODE_TYPE_MOVE_PINHOLE,
-    LL__NODE_TYPE_RESET_PINHOLE,
-  } tag;
-} ll__Node;
+typedef struct {
+  // the total number of rows, and the vertical distance from one row to the
+  // next
+  uint32_t row_count;
+  uint32_t row_height;
+  // the size of the visible region
+  ll_Size size;
+  // how far the list is scrolled down, in pixels
+  uint32_t scroll;
+} ll_VirtualListConfig;
+
+// node storage ---------------------------------------------------------------
+
+// Nodes are stored as a structure of arrays: a one-byte tag and a payload
+// offset per node, with each node's payload packed into a shared byte array at
+// its real size (so a reset_pinhole takes 4 bytes and an empty leaf none).
+
+// The type of a node
+enum ll__Tag {
+  LL__NODE_TYPE_EMPTY,
+  LL__NODE_TYPE_IMAGE,
+  LL__NODE_TYPE_TEXT,
+  LL__NODE_TYPE_ABOVE,
+  LL__NODE_TYPE_BESIDE,
+  LL__NODE_TYPE_OVERLAY,
+  LL__NODE_TYPE_MOVE_PINHOLE,
+  LL__NODE_TYPE_RESET_PINHOLE,
+  LL__NODE_TYPE_KEY,
+  LL__NODE_TYPE_CLIP,
+  LL__NODE_TYPE_ABOVE_N,
+  LL__NODE_TYPE_BESIDE_N,
+};
+
+// The payload of an image node
+typedef struct {
+  LL_IMAGE_TYPE* image_data;
+  ll_Size image_size;
+} ll__ImagePayload;
+
+// The payload of a text node
+typedef struct {
+  const char* text;
+  ll_TextConfig config;
+} ll__TextPayload;
+
+// The start of the payload of a binary node, which is followed by the
+// node's configuration (ll_AboveConfig, ll_BesideConfig or ll_OverlayConfig)
+typedef struct {
+  ll_NodeHandle first_child;
+  ll_NodeHandle second_child;
+} ll__BinaryPayload;
+
+// The start of the payload of a unary node, which is followed by the node's
+// configuration, if it has one
+typedef struct {
+  ll_NodeHandle child;
+} ll__UnaryPayload;
+
+// The start of the payload of a span node (see ll_above_n), which is followed
+// by the node's configuration, then the handles of its `child_count` children
+// and then their positions relative to the node's top-left corner (filled in
+// by ll_gen_commands)
+typedef struct {
+  uint32_t child_count;
+  // the next child for ll__emit_tree to draw
+  uint32_t next_child;
+} ll__SpanPayload;
 
 typedef struct ll__NodeArray {
   // the total underlying capacity of the array
   uint32_t capacity;
-  // the number of initialized render commands
+  // the number of initialized nodes
   uint32_t length;
-  // a pointer to the first element of the array in memory
-  ll__Node* internalArray;
+  // the tag (an ll__Tag) of each node
+  uint8_t* tags;
+  // the offset of each node's payload in `payloads`
+  uint32_t* payload_offsets;
+  // node payloads, back to back in creation order
+  char* payloads;
+  uint32_t payload_capacity;
+  uint32_t payload_length;
+  // the number of clip nodes, which the linear sweep can't emit
+  uint32_t clip_count;
+  // with glyph measurement, the glyph offsets of each text leaf measured this
+  // frame, in the arena; else NULL
+  const int32_t** glyph_x;
+  // with text hashes, the text key of each text leaf measured this frame, in
+  // the arena; else NULL
+  uint64_t* text_keys;
 } ll__NodeArray;
 
 
 // draw finalization stage =====================================================
 // --> convert node tree to iterable array
 
+// How ll_gen_commands traverses the node tree
+typedef enum {
+  // Walk the tree from the root with an explicit stack (the default)
+  LL_LAYOUT_MODE_TREE_WALK,
+  // Exploit the fact that children are always created before their parents:
+  // compute sizes in one forward sweep over the node array and positions in
+  // one backward sweep, with no traversal at all. Every node recorded before
+  // the root is measured, whether or not it is part of the tree, but only
+  // stale handles within the tree make ll_gen_commands fail. Trees in
+  // which a handle is used more than once, and frames with clips, fall back to
+  // the tree walk for positions.
+  LL_LAYOUT_MODE_LINEAR_SWEEP,
+} ll_LayoutMode;
+
+// How ll_gen_commands hands work to other threads (see ll_set_parallel_layout)
+typedef struct {
+  // Call `task(data, worker)` once for each `worker` below `worker_count`,
+  // concurrently where possible, and return once every call has returned
+  void (*dispatch)(void (*task)(void* data, uint32_t worker), void* data, uint32_t worker_count,
+                   void* user_data);
+  uint32_t worker_count;
+  void* user_data;
+} ll_ParallelConfig;
+
+// Where a context in growth mode gets memory beyond its arena (see
+// ll_enable_growth)
+typedef struct {
+  // Return a block of at least `size` bytes, aligned for any type, or NULL
+  void* (*alloc)(size_t size, void* user_data);
+  void (*free)(void* block, void* user_data);
+  void* user_data;
+} ll_Allocator;
+
+// The most memory a context has used in any one frame
+typedef struct {
+  uint32_t nodes;
+  uint32_t payload_bytes;
+  // per-frame scratch, from the arena and from blocks chained onto it
+  uint64_t frame_bytes;
+  // the number of frames that needed memory from the growth allocator
+  uint32_t grown_frames;
+} ll_MemoryStats;
+
 // Tag representing a type of render command
 typedef enum {
   LL_RENDER_DATA_TAG_IMAGE,
   LL_RENDER_DATA_TAG_TEXT,
+  // Restrict drawing to `bounds` (intersected with any enclosing scissor)
+  // until the matching SCISSOR_END. Scissors nest.
+  LL_RENDER_DATA_TAG_SCISSOR_START,
+  // Restore the scissor in effect before the matching SCISSOR_START, whose
+  // bounds it repeats
+  LL_RENDER_DATA_TAG_SCISSOR_END,
 } ll_RenderDataTag;
 
 // Data for rendering an
@@ -146,6 +273,15 @@ typedef struct {
 
 typedef struct {
   const char* text;
+  int16_t letter_spacing;
+  // with glyph measurement (see ll_set_glyph_measurement_fn), the x offset of
+  // the glyph of each byte of `text` from the left of the bounds; else NULL
+  const int32_t* glyph_x;
+  // with text hashes (see ll_enable_text_hashes), a hash of the contents of
+  // `text` and of the letter spacing when the command was generated, which
+  // ll_track_damage and ll_diff_commands compare instead, since the string may
+  // have been changed or freed by the next frame; else zero
+  uint64_t text_hash;
 } ll_TextRenderData;
 
 typedef union {
@@ -162,6 +298,8 @@ typedef struct {
   ll_Bounds bounds;
   ll_RenderDataTag tag;
   ll_RenderDataUnion render_data;
+  // the key of the nearest ll_key node above the leaf, or zero
+  uint64_t key;
 } ll_RenderCommand;
 
 // An array of render commands
@@ -174,19 +312,214 @@ typedef struct {
   ll_RenderCommand* internalArray;
 } ll_RenderCommandArray;
 
+// The kind of an ll_DiffOp
+typedef enum {
+  // `next_index` has no counterpart in the previous array
+  LL_DIFF_OP_INSERT,
+  // `prev_index` has no counterpart in the next array
+  LL_DIFF_OP_REMOVE,
+  // `prev_index` and `next_index` are the same command, which is now drawn in
+  // a different order relative to the other commands that were kept
+  LL_DIFF_OP_MOVE,
+  // `prev_index` and `next_index` are the same command, with different bounds,
+  // letter spacing, or (under an ll_key) image or text contents
+  LL_DIFF_OP_UPDATE,
+} ll_DiffOpTag;
+
+// A single diff operation. Indices an operation doesn't use are UINT32_MAX.
+typedef struct {
+  ll_DiffOpTag tag;
+  uint32_t prev_index;
+  uint32_t next_index;
+} ll_DiffOp;
+
+// An array of diff operations (see ll_diff_commands)
+typedef struct {
+  uint32_t capacity;
+  uint32_t length;
+  ll_DiffOp* internalArray;
+} ll_DiffOpArray;
+
+// The difference between two consecutive frames' render commands (see
+// ll_track_damage). Repainting every rectangle in `rects` with the commands in
+// `commands`, clipped to the rectangle, brings the previous frame up to date.
+typedef struct {
+  // dirty rectangles, which may overlap
+  ll_Bounds* rects;
+  uint32_t rect_count;
+  // the commands of the new frame that intersect some dirty rectangle, and
+  // every scissor command, in drawing order
+  ll_RenderCommandArray commands;
+} ll_Damage;
+
+// Render commands sorted into square tiles of the screen (see
+// ll_bin_commands), in compressed sparse rows: tile `t`, counting along each
+// row of tiles from the top-left, draws commands indices[offsets[t]] up to but
+// not including indices[offsets[t + 1]], in drawing order
+typedef struct {
+  ll_Size screen;
+  uint32_t tile_size;
+  uint32_t columns;
+  uint32_t rows;
+  // columns * rows + 1 entries
+  uint32_t* offsets;
+  uint32_t* indices;
+} ll_TileBins;
+
 
 // context data ================================================================
 
+// Counters describing how effective a measurement cache has been
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} ll_CacheStats;
+
+typedef struct {
+  uint64_t key;
+  ll_Size size;
+  // neighbours in the recency list, which runs from most to least recent
+  uint32_t prev, next;
+  // the next entry in the same hash bucket
+  uint32_t bucket_next;
+} ll__SizeCacheEntry;
+
+// A fixed-capacity map from 64-bit keys to sizes, evicting the least recently
+// used entry when full. Disabled while `capacity` is zero.
+typedef struct {
+  ll__SizeCacheEntry* entries;
+  // the first entry in each bucket; there are `bucket_mask + 1` of them
+  uint32_t* buckets;
+  uint32_t bucket_mask;
+  uint32_t capacity;
+  // the number of entries that have ever been used
+  uint32_t length;
+  // the most and least recently used entries
+  uint32_t head, tail;
+  // entries freed by removal, chained through `bucket_next`
+  uint32_t free;
+  ll_CacheStats stats;
+} ll__SizeCache;
+
+// A combinator subtree laid out by ll_gen_commands
+typedef struct {
+  uint64_t hash;
+  // the key in effect above the subtree (see ll_key)
+  uint64_t key;
+  // checked on every hit, so that subtrees that merely share a hash differ
+  uint8_t tag;
+  uint32_t child_count;
+  ll_Size size;
+  ll_Vec2 pinhole;
+  // where the subtree's top-left corner was drawn
+  ll_Vec2 posn;
+  // the run of render commands the subtree drew
+  uint32_t first_command;
+  uint32_t command_count;
+} ll__SubtreeEntry;
+
+// The combinator subtrees of one generated tree, in pre-order, and the render
+// commands they drew. The descendants of an entry are the entries that follow
+// it with a first command inside its run.
 typedef struct {
+  ll__SubtreeEntry* entries;
+  uint32_t entry_count;
+  ll_RenderCommand* commands;
+  uint32_t command_count;
+} ll__SubtreeFrame;
+
+// Remembers the layout and render commands of every combinator subtree of the
+// last tree generated, keyed by a structural hash, so that unchanged subtrees
+// of the next tree can be spliced in instead of laid out again. Disabled while
+// `capacity` is zero.
+typedef struct {
+  // the structural hash of each node of the current generation, or zero if
+  // the node (or one of its descendants) has an invalid child
+  uint64_t* hashes;
+  // the last tree generated is `frames[current]`; the other one is filled in
+  // while generating the next
+  ll__SubtreeFrame frames[2];
+  uint32_t current;
+  // an open-addressed index of `frames[current].entries` by hash
+  uint32_t* table;
+  uint32_t table_mask;
+  // the number of entries and of render commands each frame can hold
+  uint32_t capacity;
+  ll_CacheStats stats;
+} ll__SubtreeCache;
+
+// A copy of the render commands last passed to ll_track_damage. Disabled
+// while `capacity` is zero.
+typedef struct {
+  ll_RenderCommand* commands;
+  uint32_t length;
+  uint32_t capacity;
+  // false until there is a previous frame to compare against
+  bool valid;
+  // the extent of the last frame, if it had too many commands to remember
+  ll_Bounds overflow;
+} ll__DamageTracker;
+
+// An open-addressed set of the nodes of the current generation, by contents.
+// Slots holding a handle from another generation count as empty, so the set
+// never needs clearing. Disabled while `handles` is NULL.
+typedef struct {
+  ll_NodeHandle* handles;
+  uint32_t mask;
+} ll__InternTable;
+
+// A block chained onto the arena in growth mode, followed by its bytes
+typedef struct ll__ArenaBlock {
+  struct ll__ArenaBlock* next;
+  size_t capacity;
+  size_t used;
+} ll__ArenaBlock;
+
+typedef struct {
+  // offset of the next free byte, relative to `mem`
   uintptr_t next_alloc;
+  // offset of the first per-frame allocation; everything before it (the
+  // context and the node array) survives ll_begin
+  uintptr_t frame_start;
   size_t capacity;
   char* mem;
+  // in growth mode, where per-frame allocations go once `mem` runs out: the
+  // blocks chained on this frame, newest first, and the bytes handed out
+  // from them
+  ll_Allocator allocator;
+  ll__ArenaBlock* blocks;
+  uint64_t block_bytes;
 } ll__Arena;
 
 struct ll_Context {
   uint32_t max_nodes;
+  // incremented by every ll_begin, skipping zero; wraps around after
+  // 2^(32 - LL_HANDLE_INDEX_BITS) - 1 frames
+  uint32_t generation;
+  ll_LayoutMode layout_mode;
+  ll_ParallelConfig parallel;
   ll__Arena arena;
   ll__NodeArray nodes;
+  ll__SizeCache text_cache;
+  ll__SizeCache image_cache;
+  ll__SubtreeCache subtree_cache;
+  ll__InternTable interned;
+  ll__DamageTracker damage;
+  // whether render commands carry text hashes
+  bool text_hashes;
+  // growth mode: the allocator, which takes effect at ll_begin, and the node
+  // array and node-indexed tables in the arena, which the context goes back
+  // to at ll_begin once it has outgrown them
+  ll_Allocator allocator;
+  bool grown;
+  ll__NodeArray home_nodes;
+  uint64_t* home_hashes;
+  ll__InternTable home_interned;
+  // the number of subcontexts recording into the node array, which can't move
+  // while there are any
+  uint32_t subcontexts;
+  ll_MemoryStats high_water;
 };
 
 
@@ -197,25 +530,174 @@ struct ll_Context {
 // Configure the function looseleaf uses to measure text.
 // Required before creating a context.
 void ll_set_text_measurement_fn(ll_Size (*text_measurement_fn)(const char* text, uint16_t letter_spacing));
+// Configure a function that measures many strings at once, as an alternative
+// to ll_set_text_measurement_fn that lets the backend amortize font lookups.
+// Before laying out a tree, looseleaf gathers the text leaves it is about to
+// lay out (those of the tree, outside subtrees the subtree cache remembers;
+// every one recorded before the root in the linear sweep and the parallel
+// layout, which lay out all of them) that aren't in the text cache and passes
+// them to `text_batch_measurement_fn`, which must fill `sizes[i]` with the
+// size of `texts[i]` set with `letter_spacings[i]`, for all `count` of them.
+// Pass NULL to go back to measuring one leaf at a time.
+void ll_set_text_batch_measurement_fn(void (*text_batch_measurement_fn)(
+    const char* const* texts, const uint16_t* letter_spacings, ll_Size* sizes, uint32_t count));
+// Configure a function that measures text like the text measurement function
+// and also writes the x offset of the glyph of each byte of `text` to
+// `glyph_x`, which has room for one per byte, or is NULL if the arena is
+// exhausted. Text render commands then carry these offsets, so the backend can
+// draw without walking the string again. The offsets take up 4 bytes of arena
+// per byte of text each frame, on top of ll_min_arena_size. While this is set,
+// text is measured by this function alone, each frame: the text cache, batch
+// measurement and the subtree cache aren't used. Pass NULL to turn it off.
+void ll_set_glyph_measurement_fn(ll_Size (*glyph_measurement_fn)(const char* text, uint16_t letter_spacing,
+                                                                 int32_t* glyph_x));
 // Configure the function looseleaf uses to measure images.
 // Required before creating a context.
 void ll_set_image_measurement_fn(ll_Size (*image_measurement_fn)(LL_IMAGE_TYPE* image));
-// Configure the maximum number of nodes that can be "in flight" at a given time
+// Configure the maximum number of nodes that can be "in flight" at a given time,
+// for contexts initialized on the calling thread.
+// This can't exceed 2^LL_HANDLE_INDEX_BITS - 2.
 void ll_configure_max_nodes(uint32_t max_nodes);
-// Return the minimum size of an arena used to initialize the looseleaf context
+// Return the minimum size of an arena used to initialize the looseleaf context.
+// This covers the context, the node array, and the per-frame scratch needed to
+// lay out a tree of `max_nodes` nodes in which no handle is used twice
+// (including batched text measurement, if a batch function is configured).
 uint64_t ll_min_arena_size(void);
-// Initialize a looseleaf context from a memory arena
+// Initialize a looseleaf context from a memory arena. The context itself lives
+// at the start of `arena_mem`; returns NULL if the arena is too small.
 // TODO error if measurement functions aren't set up properly
 ll_Context* ll_init(char* arena_mem, size_t arena_capacity);
+// Configure how ll_gen_commands traverses the tree; see ll_LayoutMode
+void ll_set_layout_mode(ll_Context* ctx, ll_LayoutMode mode);
+// Lay out trees on the threads behind `conf.dispatch`. ll_gen_commands splits
+// the tree into independent subtrees, which the workers size concurrently,
+// stealing from each other as they run out, and then draw into their own
+// slices of the render command array. Leaves are still measured on the calling
+// thread, so the measurement functions needn't be thread-safe. Trees in which
+// a combinator has two parents, and frames with clips, a viewport, a subtree
+// cache or the linear sweep, are generated serially. A `worker_count` of zero
+// turns this off.
+void ll_set_parallel_layout(ll_Context* ctx, ll_ParallelConfig conf);
+// Let the node array and the per-frame scratch outgrow the arena, with blocks
+// from `allocator`, so that the arena can be sized for a typical frame while
+// rare large frames still succeed. The blocks are returned at the next
+// ll_begin (or ll_release_blocks), when the context goes back to the arena
+// alone. Takes effect from the next ll_begin. Subcontexts don't grow, nor
+// does their parent while they're recording.
+void ll_enable_growth(ll_Context* ctx, ll_Allocator allocator);
+// Return every block the context holds from the growth allocator. Handles and
+// render commands of the current frame are invalid afterwards.
+void ll_release_blocks(ll_Context* ctx);
+// Return the most nodes, payload bytes and per-frame scratch any frame of the
+// context has used so far, for sizing the arena with ll_configure_max_nodes
+ll_MemoryStats ll_memory_stats(const ll_Context* ctx);
+// Return the number of arena bytes parallel layout with `worker_count` workers
+// needs each frame, on top of ll_min_arena_size. Without them, ll_gen_commands
+// generates serially.
+uint64_t ll_parallel_layout_arena_size(uint32_t worker_count);
+// Return the number of arena bytes a measurement cache of `capacity` entries
+// takes up, on top of ll_min_arena_size
+uint64_t ll_cache_arena_size(uint32_t capacity);
+// Cache up to `capacity` text measurements, keyed by the contents of the
+// string and the letter spacing, across frames. The cache is carved out of the
+// arena for the lifetime of the context, so call this once, between ll_init
+// and the first ll_begin. Returns false if the arena is too small.
+bool ll_enable_text_cache(ll_Context* ctx, uint32_t capacity);
+// Return the hit, miss and eviction counts of the text measurement cache
+ll_CacheStats ll_text_cache_stats(const ll_Context* ctx);
+// Cache up to `capacity` image measurements, keyed by the LL_IMAGE_TYPE
+// pointer, across frames. Like ll_enable_text_cache, call this once, between
+// ll_init and the first ll_begin. Returns false if the arena is too small.
+bool ll_enable_image_cache(ll_Context* ctx, uint32_t capacity);
+// Forget the cached size of `image`, for when it is reloaded or freed. This
+// also forgets every remembered subtree.
+void ll_invalidate_image(ll_Context* ctx, LL_IMAGE_TYPE* image);
+// Return the hit, miss and eviction counts of the image measurement cache
+ll_CacheStats ll_image_cache_stats(const ll_Context* ctx);
+// Return the number of arena bytes a subtree cache of `capacity` entries takes
+// up, on top of ll_min_arena_size (including its per-frame scratch)
+uint64_t ll_subtree_cache_arena_size(uint32_t capacity);
+// Remember the layout and render commands of up to `capacity` combinator
+// subtrees (drawing up to `capacity` render commands) of each generated tree,
+// so that the next ll_gen_commands can splice in the output of subtrees that
+// haven't changed, recognized by a hash of their tags, configurations and
+// leaves (text is compared by contents and by pointer). Only the tree walk
+// layout mode uses the cache. Like ll_enable_text_cache, call this once,
+// between ll_init and the first ll_begin. Returns false if the arena is too
+// small.
+bool ll_enable_subtree_cache(ll_Context* ctx, uint32_t capacity);
+// Forget every remembered subtree, for when the measurement functions would
+// now measure something differently
+void ll_invalidate_subtrees(ll_Context* ctx);
+// Return the hit, miss and eviction counts of the subtree cache, where a miss
+// is a combinator that had to be laid out and an eviction is a combinator
+// there was no room to remember
+ll_CacheStats ll_subtree_cache_stats(const ll_Context* ctx);
+// Return the number of arena bytes hash-consing takes up, on top of
+// ll_min_arena_size
+uint64_t ll_hash_consing_arena_size(void);
+// Make ll_image, ll_text and the combinators return the existing handle when
+// an identical node (the same configuration, data and child handles; text is
+// compared by contents) has already been created in the current frame. Trees
+// become DAGs that share their repeated subtrees, which take up arena space
+// and get laid out only once. Like ll_enable_text_cache, call this once,
+// between ll_init and the first ll_begin. Returns false if the arena is too
+// small.
+bool ll_enable_hash_consing(ll_Context* ctx);
+// Return the number of arena bytes text hashes take up each frame, on top of
+// ll_min_arena_size
+uint64_t ll_text_hashes_arena_size(void);
+// Fill in ll_TextRenderData.text_hash, which ll_diff_commands compares, in the
+// render commands of every frame. Text leaves are otherwise never hashed for
+// them. Like ll_enable_text_cache, call this once, between ll_init and the
+// first ll_begin.
+void ll_enable_text_hashes(ll_Context* ctx);
+// Return the number of arena bytes damage tracking for frames of up to
+// `capacity` render commands takes up, on top of ll_min_arena_size (including
+// its per-frame scratch and text hashes)
+uint64_t ll_damage_tracking_arena_size(uint32_t capacity);
+// Keep a copy of the render commands of each frame, of up to `capacity`
+// commands, for ll_track_damage to compare the next frame against. This also
+// enables text hashes (see ll_enable_text_hashes). Like ll_enable_text_cache,
+// call this once, between ll_init and the first ll_begin. Returns false if the
+// arena is too small.
+bool ll_enable_damage_tracking(ll_Context* ctx, uint32_t capacity);
+// Make the next ll_track_damage report the whole frame as dirty, for when the
+// backend has lost what is on screen
+void ll_invalidate_damage(ll_Context* ctx);
 
 // per-frame recording...
 
-// Clear the looseleaf context and set it up for recording
+// Clear the looseleaf context and set it up for recording, making it the
+// current context of the calling thread. This only rewinds the arena, so it
+// runs in constant time regardless of the previous frame. Handles created
+// before the call are stale afterwards, until the generation comes around
+// again (see LL_HANDLE_INDEX_BITS).
 void ll_begin(ll_Context* ctx);
+// Make `ctx` the context that the calling thread records into and generates
+// render commands from, without clearing it. Each context must only be used by
+// one thread at a time.
+void ll_set_current_context(ll_Context* ctx);
+// Reserve room for `max_nodes` nodes in the frame being recorded into `ctx`,
+// and return a context that records into just that room, or NULL if `ctx` is
+// full. The new context can be made current on another thread (see
+// ll_set_current_context) to record a subtree there while `ctx` carries on.
+// Its handles are already handles of `ctx`, so nodes of `ctx` created after
+// this call can take them once they're grafted. It can't generate render
+// commands or use hash-consing, and only lasts until the next ll_begin.
+ll_Context* ll_begin_subcontext(ll_Context* ctx, uint32_t max_nodes);
+// Graft the subtree `root`, recorded into `sub` (see ll_begin_subcontext),
+// into `ctx`, returning its handle there. This takes constant time; `sub`
+// can't record anything more afterwards.
+ll_NodeHandle ll_graft(ll_Context* ctx, ll_Context* sub, ll_NodeHandle root);
+
+// Return the handle of the empty leaf, which exists in every generation
+ll_NodeHandle ll_empty(void);
 
 // DESIGN: data comes after configuration, in case function calls are nested
 
-// Allocate a leaf representing an image, with data defined by LL_IMAGE_TYPE
+// Allocate a leaf representing an image, with data defined by LL_IMAGE_TYPE.
+// An `image_size` of {0, 0} asks the image measurement function for the size.
 ll_NodeHandle ll_image(LL_IMAGE_TYPE* image_data, ll_Size image_size);
 // Allocate a leaf represeting a string of text
 ll_NodeHandle ll_text(ll_TextConfig conf, const char* text);
@@ -225,13 +707,117 @@ ll_NodeHandle ll_above(ll_AboveConfig conf, ll_NodeHandle above, ll_NodeHandle b
 ll_NodeHandle ll_beside(ll_BesideConfig conf, ll_NodeHandle left, ll_NodeHandle right);
 // Allocate a binary node that renders the first node on top of the second
 ll_NodeHandle ll_overlay(ll_OverlayConfig conf, ll_NodeHandle over, ll_NodeHandle under);
+// Allocate a node that renders `count` nodes from top to bottom, laid out just
+// like LL_FOLDL1(ll_above, conf, ...) but without the count - 1 binary nodes
+// in between. `nodes` is copied, and an empty or one-node array gives back the
+// empty leaf or that node.
+ll_NodeHandle ll_above_n(ll_AboveConfig conf, const ll_NodeHandle* nodes, uint32_t count);
+// Allocate a node that renders `count` nodes from left to right, laid out just
+// like LL_FOLDL1(ll_beside, conf, ...)
+ll_NodeHandle ll_beside_n(ll_BesideConfig conf, const ll_NodeHandle* nodes, uint32_t count);
+
+// Fold the array `nodes` from the left with the binary combinator `combinator`
+// (ll_above, ll_beside or ll_overlay) and its configuration `conf`, giving a
+// chain of nodes as deep as the array is long. An empty array folds to the
+// empty leaf.
+#define LL_FOLDL1(combinator, conf, nodes) \
+  ll__fold(LL__FOLD_TAG_##combinator, (LL__FOLD_CONF_##combinator[]){conf}, sizeof(LL__FOLD_CONF_##combinator), \
+           (nodes), sizeof(nodes) / sizeof(*(nodes)), false)
+// Fold the array `nodes` like LL_FOLDL1, but into a balanced tree of depth
+// log2 of the array's length. The combinators are associative, so this gives
+// the same layout as LL_FOLDL1, except for offsets across the direction of
+// stacking and rounding when centering.
+#define LL_FOLD_TREE(combinator, conf, nodes) \
+  ll__fold(LL__FOLD_TAG_##combinator, (LL__FOLD_CONF_##combinator[]){conf}, sizeof(LL__FOLD_CONF_##combinator), \
+           (nodes), sizeof(nodes) / sizeof(*(nodes)), true)
+
+#define LL__FOLD_TAG_ll_above LL__NODE_TYPE_ABOVE
+#define LL__FOLD_TAG_ll_beside LL__NODE_TYPE_BESIDE
+#define LL__FOLD_TAG_ll_overlay LL__NODE_TYPE_OVERLAY
+#define LL__FOLD_CONF_ll_above ll_AboveConfig
+#define LL__FOLD_CONF_ll_beside ll_BesideConfig
+#define LL__FOLD_CONF_ll_overlay ll_OverlayConfig
 // Allocate a unary node that moves a node's pinhole as defined by `conf`
 ll_NodeHandle ll_move_pinhole(ll_MovePinholeConfig conf, ll_NodeHandle node);
 // Allocate a unary node that resets a node's pinhole to its original position
 ll_NodeHandle ll_reset_pinhole(ll_NodeHandle node);
+// Allocate a unary node that tags the render commands of `node` with `key`
+// (see ll_diff_commands), overriding any key further up the tree. Keys should
+// be unique among siblings that can trade places, like the items of a list,
+// and differ from the keys above them.
+ll_NodeHandle ll_key(uint64_t key, ll_NodeHandle node);
+// Allocate a unary node that shows only the part of `node` inside a region of
+// `conf.size`, wrapping its render commands in a scissor. Parts of `node`
+// entirely outside the region are left out of the render commands.
+ll_NodeHandle ll_clip(ll_ClipConfig conf, ll_NodeHandle node);
+// Allocate a scrolling list of `conf.row_count` rows, clipped to `conf.size`
+// like ll_clip, calling `build_row(row, user_data)` for just the rows in view.
+// Each row's pinhole goes at the left edge of its slot; rows taller than
+// `conf.row_height` overlap the next. Arena use and layout time depend on the
+// number of visible rows, not on `conf.row_count`.
+// This is narrower than a lazy list node on purpose. The rows are built here,
+// while recording, and not during ll_gen_commands, since a node has to be
+// created before its parent for its handle to be valid there. So which rows
+// are in view is decided by `conf.size` and `conf.scroll` alone, not by clips
+// or viewports further up the tree, and every row takes `conf.row_height`,
+// with no estimated heights for rows not yet built.
+ll_NodeHandle ll_virtual_list(ll_VirtualListConfig conf, ll_NodeHandle (*build_row)(uint32_t row, void* user_data),
+                              void* user_data);
 
-// Generate an iterable array of render commands from an ll_NodeHandle
+// Generate an iterable array of render commands from an ll_NodeHandle. The
+// array lives in the arena until the next ll_begin; on failure (a stale or
+// invalid handle anywhere in the tree, or an arena too small for the layout)
+// it is empty.
 ll_RenderCommandArray ll_gen_commands(ll_NodeHandle root);
+// Like ll_gen_commands, but leave out every subtree whose box lies outside
+// `viewport`, without visiting it. Sizes are still computed for the whole
+// tree, but the cost of generating commands (and the length of the array)
+// depends only on what is visible. Subtrees spliced in from the subtree cache
+// are culled command by command instead, with the same result.
+ll_RenderCommandArray ll_gen_commands_clipped(ll_NodeHandle root, ll_Bounds viewport);
+// Compare `cmds` against the commands last passed to this function and return
+// the regions that changed, then remember `cmds` for the next frame. A command
+// that was added, removed, moved or reordered past another dirties its bounds
+// in both frames; text is compared by contents, so a string buffer reused from
+// frame to frame is fine. The first frame, and any frame after
+// ll_invalidate_damage or with more commands than damage tracking was enabled
+// for, is dirty wherever either frame draws. The result lives in the arena
+// until the next ll_begin; it is empty if damage tracking isn't enabled or the
+// arena is exhausted.
+ll_Damage ll_track_damage(ll_Context* ctx, ll_RenderCommandArray cmds);
+// Return the number of arena bytes ll_diff_commands needs to compare arrays of
+// up to `max_commands` commands each
+uint64_t ll_diff_commands_arena_size(uint32_t max_commands);
+// Return the operations that turn `prev` into `next`: first every remove, in
+// order of `prev_index`, then every insert, move and update, in order of
+// `next_index`. A moved command that also changed gets both a move and an
+// update. Commands keep their identity from one array to the other when they
+// are of the same kind and have the same key (see ll_key), or, outside of any
+// key, the same image or text with the same contents and letter spacing (see
+// ll_TextRenderData.text_hash, which needs ll_enable_text_hashes), and the
+// same number of such commands come before them in drawing order. `prev` is typically a copy of the last frame's
+// commands, since the arena is rewound by ll_begin. The operations live in the
+// arena of `ctx` until the next ll_begin; if the arena is exhausted,
+// `internalArray` is NULL.
+ll_DiffOpArray ll_diff_commands(ll_Context* ctx, ll_RenderCommandArray prev, ll_RenderCommandArray next);
+// Return the number of arena bytes ll_bin_commands needs, at worst, to bin up
+// to `max_commands` commands into tiles of `tile_size` pixels on `screen`
+uint64_t ll_bin_commands_arena_size(uint32_t max_commands, ll_Size screen, uint32_t tile_size);
+// Sort `cmds` into tiles of `tile_size` by `tile_size` pixels covering
+// `screen`, whose top-left corner is the origin. Each command goes in every
+// tile that its bounds, clipped by the scissors around it, overlap; each
+// scissor goes in every tile its clipped bounds overlap, along with its
+// matching SCISSOR_END. Drawing a tile's commands clipped to the tile draws
+// exactly what drawing every command would draw there, so tiles can be drawn
+// on separate threads without locking, and tiles without commands can be
+// skipped. The bins live in the arena of `ctx` until the next ll_begin; if the
+// arena is exhausted, `offsets` is NULL.
+ll_TileBins ll_bin_commands(ll_Context* ctx, ll_RenderCommandArray cmds, ll_Size screen, uint32_t tile_size);
+// Return the pixels tile `tile` of `bins` covers, within the screen
+ll_Bounds ll_tile_bounds(const ll_TileBins* bins, uint32_t tile);
+// Return whether tile `tile` of `bins` overlaps any of the rectangles of
+// `damage`, and so needs to be drawn again
+bool ll_tile_damaged(const ll_TileBins* bins, uint32_t tile, ll_Damage damage);
 
 
 //    +------------------+
@@ -240,47 +826,2532 @@ ll_RenderCommandArray ll_gen_commands(ll_NodeHandle root);
 
 // program state (ugly, gross, disgraceful) ====================================
 
-ll_Context* ll__current_context;
-uint32_t ll__max_nodes = 4096;
+LL_THREAD_LOCAL ll_Context* ll__current_context;
+LL_THREAD_LOCAL uint32_t ll__max_nodes = 4096;
+
+#define LL__HANDLE_INDEX_MASK ((UINT32_C(1) << LL_HANDLE_INDEX_BITS) - 1)
+#define LL__GENERATION_MASK (UINT32_MAX >> LL_HANDLE_INDEX_BITS)
+
+// The most payload bytes any one node needs, including alignment padding.
+// Span nodes take more, but stand in for several binary nodes.
+#define LL__MAX_PAYLOAD_SIZE (sizeof(ll__BinaryPayload) + sizeof(ll_OverlayConfig))
+
+// Returned in place of a node that could not be allocated. No context ever
+// has generation zero, so this handle is always stale.
+#define LL__INVALID_HANDLE 0
 
 // private functions ===========================================================
 
 // TODO find a home for these
 
+ll_Size (*ll__text_measurement_fn)(const char* text, uint16_t letter_spacing);
+ll_Size (*ll__image_measurement_fn)(LL_IMAGE_TYPE* image);
+void (*ll__text_batch_measurement_fn)(const char* const* texts, const uint16_t* letter_spacings,
+                                      ll_Size* sizes, uint32_t count);
+ll_Size (*ll__glyph_measurement_fn)(const char* text, uint16_t letter_spacing, int32_t* glyph_x);
+
+// arena allocation ------------------------------------------------------------
+
+// Bump-allocate from the newest chained block, chaining on a new one twice
+// its size if it's full. Returns NULL outside of growth mode.
+void* ll__arena_alloc_block(ll__Arena* arena, size_t size, size_t align) {
+  if (arena->allocator.alloc == NULL) return NULL;
+  ll__ArenaBlock* block = arena->blocks;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (block != NULL) {
+      uintptr_t base = (uintptr_t)(block + 1);
+      uintptr_t start = (base + block->used + (align - 1)) & ~(uintptr_t)(align - 1);
+      size_t offset = start - base;
+      if (offset <= block->capacity && size <= block->capacity - offset) {
+        arena->block_bytes += offset + size - block->used;
+        block->used = offset + size;
+        return (void*)start;
+      }
+    }
+    size_t capacity = block != NULL ? block->capacity * 2 : arena->capacity / 2;
+    if (capacity < size + align) capacity = size + align;
+    block = arena->allocator.alloc(sizeof(ll__ArenaBlock) + capacity, arena->allocator.user_data);
+    if (block == NULL) return NULL;
+    *block = (ll__ArenaBlock){.next = arena->blocks, .capacity = capacity};
+    arena->blocks = block;
+  }
+  return NULL;
+}
+
+// Return every chained block to the allocator
+void ll__arena_free_blocks(ll__Arena* arena) {
+  while (arena->blocks != NULL) {
+    ll__ArenaBlock* next = arena->blocks->next;
+    if (arena->allocator.free != NULL) arena->allocator.free(arena->blocks, arena->allocator.user_data);
+    arena->blocks = next;
+  }
+  arena->block_bytes = 0;
+}
+
+// Bump-allocate `size` bytes aligned to `align` (a power of two), returning
+// NULL if the arena is exhausted. Nothing is ever freed individually; the
+// per-frame region is released all at once by ll_begin.
+void* ll__arena_alloc(ll__Arena* arena, size_t size, size_t align) {
+  uintptr_t base = (uintptr_t)arena->mem;
+  uintptr_t start = (base + arena->next_alloc + (align - 1)) & ~(uintptr_t)(align - 1);
+  size_t offset = start - base;
+  if (offset > arena->capacity || size > arena->capacity - offset) return ll__arena_alloc_block(arena, size, align);
+  arena->next_alloc = offset + size;
+  return (void*)start;
+}
+
+#define LL__ARENA_ALLOC(arena, type, count)                                    \
+  ((type*)ll__arena_alloc((arena), sizeof(type) * (size_t)(count), _Alignof(type)))
+
+// Allocate a payload pool of `size` bytes. Payloads are aligned relative to the
+// start of the pool, so the pool itself is aligned for any type.
+#define LL__ALLOC_PAYLOADS(arena, size) ((char*)ll__arena_alloc((arena), (size_t)(size), _Alignof(max_align_t)))
+
+// The number of arena bytes that `count` values of `type` can take up,
+// including the worst-case padding needed to align them.
+#define LL__ARENA_FOOTPRINT(type, count) (sizeof(type) * (uint64_t)(count) + _Alignof(type) - 1)
+
+// node allocation -------------------------------------------------------------
+
+// In growth mode, move the node array of `ctx` (and the tables indexed by
+// node) to per-frame scratch with room for at least `node_count` nodes and
+// `payload_size` bytes of payload, doubling whichever is short. Returns false
+// if it can't grow.
+bool ll__grow_nodes(ll_Context* ctx, uint64_t node_count, uint64_t payload_size) {
+  ll__NodeArray* nodes = &ctx->nodes;
+  if (ctx->arena.allocator.alloc == NULL || ctx->subcontexts > 0) return false;
+  if (node_count > LL__HANDLE_INDEX_MASK || payload_size > UINT32_MAX) return false;
+  if (!ctx->grown) {
+    ctx->home_nodes = *nodes;
+    ctx->home_hashes = ctx->subtree_cache.hashes;
+    ctx->home_interned = ctx->interned;
+  }
+
+  uint64_t capacity = nodes->capacity;
+  while (capacity < node_count) capacity *= 2;
+  if (capacity > LL__HANDLE_INDEX_MASK) capacity = LL__HANDLE_INDEX_MASK;
+  if (capacity > nodes->capacity) {
+    uint8_t* tags = LL__ARENA_ALLOC(&ctx->arena, uint8_t, capacity);
+    uint32_t* payload_offsets = LL__ARENA_ALLOC(&ctx->arena, uint32_t, capacity);
+    if (tags == NULL || payload_offsets == NULL) return false;
+    if (ctx->subtree_cache.hashes != NULL) {
+      uint64_t* hashes = LL__ARENA_ALLOC(&ctx->arena, uint64_t, capacity);
+      if (hashes == NULL) return false;
+      memcpy(hashes, ctx->subtree_cache.hashes, sizeof(uint64_t) * nodes->length);
+      ctx->subtree_cache.hashes = hashes;
+    }
+    if (ctx->interned.handles != NULL) {
+      // the nodes recorded so far are forgotten, which only costs sharing
+      uint32_t table_size = 1;
+      while (table_size < 2 * capacity) table_size <<= 1;
+      ll_NodeHandle* handles = LL__ARENA_ALLOC(&ctx->arena, ll_NodeHandle, table_size);
+      if (handles == NULL) return false;
+      for (uint32_t i = 0; i < table_size; i++) handles[i] = LL__INVALID_HANDLE;
+      ctx->interned = (ll__InternTable){.handles = handles, .mask = table_size - 1};
+    }
+    memcpy(tags, nodes->tags, nodes->length);
+    memcpy(payload_offsets, nodes->payload_offsets, sizeof(uint32_t) * nodes->length);
+    nodes->tags = tags;
+    nodes->payload_offsets = payload_offsets;
+    nodes->capacity = (uint32_t)capacity;
+  }
+
+  uint64_t payload_capacity = nodes->payload_capacity > 0 ? nodes->payload_capacity : 1;
+  while (payload_capacity < payload_size) payload_capacity *= 2;
+  if (payload_capacity > UINT32_MAX) payload_capacity = UINT32_MAX;
+  if (payload_capacity > nodes->payload_capacity) {
+    char* payloads = LL__ALLOC_PAYLOADS(&ctx->arena, payload_capacity);
+    if (payloads == NULL) return false;
+    memcpy(payloads, nodes->payloads, nodes->payload_length);
+    nodes->payloads = payloads;
+    nodes->payload_capacity = (uint32_t)payload_capacity;
+  }
+  ctx->grown = true;
+  return nodes->capacity >= node_count && nodes->payload_capacity >= payload_size;
+}
+
+// Claim the next node of the current context and `size` bytes of payload for
+// it, returning the payload, or NULL if the node array is full.
+void* ll__alloc_node(enum ll__Tag tag, uint32_t size, uint32_t align, ll_NodeHandle* handle) {
+  ll_Context* ctx = ll__current_context;
+  ll__NodeArray* nodes = &ctx->nodes;
+  uint64_t offset = (nodes->payload_length + (uint64_t)align - 1) & ~(uint64_t)(align - 1);
+  if ((nodes->length == nodes->capacity || offset + size > nodes->payload_capacity) &&
+      !ll__grow_nodes(ctx, (uint64_t)nodes->length + 1, offset + size)) {
+    return NULL;
+  }
+
+  *handle = (ctx->generation << LL_HANDLE_INDEX_BITS) | nodes->length;
+  nodes->tags[nodes->length] = (uint8_t)tag;
+  nodes->payload_offsets[nodes->length] = (uint32_t)offset;
+  nodes->length++;
+  nodes->payload_length = (uint32_t)(offset + size);
+  return nodes->payloads + offset;
+}
+
+#define LL__ALLOC_NODE(tag, type, handle) \
+  ((type*)ll__alloc_node((tag), sizeof(type), _Alignof(type), (handle)))
+
+// Return a pointer to the payload of the node at `index`
+#define LL__PAYLOAD(nodes, index, type) \
+  ((const type*)((nodes)->payloads + (nodes)->payload_offsets[index]))
+
+// Return a pointer to the configuration that follows a binary or unary payload
+#define LL__PAYLOAD_CONFIG(payload, type) ((const type*)((payload) + 1))
+
+// Return the key of the ll_key node at `index`, or zero for index zero. The
+// key follows a 4-byte payload, so it is copied out rather than dereferenced.
+uint64_t ll__node_key(const ll__NodeArray* nodes, uint32_t index) {
+  uint64_t key = 0;
+  if (index != 0) memcpy(&key, LL__PAYLOAD(nodes, index, ll__UnaryPayload) + 1, sizeof(key));
+  return key;
+}
+
+// measurement caches ----------------------------------------------------------
+
+#define LL__NIL UINT32_MAX
+
+// Carve a cache of `capacity` entries out of the arena, returning false if it
+// doesn't fit
+bool ll__size_cache_init(ll__SizeCache* cache, ll__Arena* arena, uint32_t capacity) {
+  uint32_t bucket_count = 1;
+  while (bucket_count < capacity) bucket_count <<= 1;
+  ll__SizeCacheEntry* entries = LL__ARENA_ALLOC(arena, ll__SizeCacheEntry, capacity);
+  uint32_t* buckets = LL__ARENA_ALLOC(arena, uint32_t, bucket_count);
+  if (entries == NULL || buckets == NULL) return false;
+
+  for (uint32_t i = 0; i < bucket_count; i++) buckets[i] = LL__NIL;
+  *cache = (ll__SizeCache){
+      .entries = entries,
+      .buckets = buckets,
+      .bucket_mask = bucket_count - 1,
+      .capacity = capacity,
+      .head = LL__NIL,
+      .tail = LL__NIL,
+      .free = LL__NIL,
+  };
+  return true;
+}
+
+void ll__size_cache_unlink(ll__SizeCache* cache, uint32_t index) {
+  ll__SizeCacheEntry* entry = &cache->entries[index];
+  if (entry->prev != LL__NIL) cache->entries[entry->prev].next = entry->next;
+  else cache->head = entry->next;
+  if (entry->next != LL__NIL) cache->entries[entry->next].prev = entry->prev;
+  else cache->tail = entry->prev;
+}
+
+void ll__size_cache_push_front(ll__SizeCache* cache, uint32_t index) {
+  ll__SizeCacheEntry* entry = &cache->entries[index];
+  entry->prev = LL__NIL;
+  entry->next = cache->head;
+  if (cache->head != LL__NIL) cache->entries[cache->head].prev = index;
+  else cache->tail = index;
+  cache->head = index;
+}
+
+// Look up `key`, marking it most recently used. Returns false on a miss.
+bool ll__size_cache_get(ll__SizeCache* cache, uint64_t key, ll_Size* size) {
+  uint32_t index = cache->buckets[key & cache->bucket_mask];
+  while (index != LL__NIL && cache->entries[index].key != key) index = cache->entries[index].bucket_next;
+  if (index == LL__NIL) {
+    cache->stats.misses++;
+    return false;
+  }
+  cache->stats.hits++;
+  if (index != cache->head) {
+    ll__size_cache_unlink(cache, index);
+    ll__size_cache_push_front(cache, index);
+  }
+  *size = cache->entries[index].size;
+  return true;
+}
+
+// Remove the entry at `index` from its hash bucket
+void ll__size_cache_unbucket(ll__SizeCache* cache, uint32_t index) {
+  uint32_t* link = &cache->buckets[cache->entries[index].key & cache->bucket_mask];
+  while (*link != index) link = &cache->entries[*link].bucket_next;
+  *link = cache->entries[index].bucket_next;
+}
+
+// Insert `key`, which must not be cached yet, evicting the least recently used
+// entry if the cache is full
+void ll__size_cache_put(ll__SizeCache* cache, uint64_t key, ll_Size size) {
+  uint32_t index;
+  if (cache->free != LL__NIL) {
+    index = cache->free;
+    cache->free = cache->entries[index].bucket_next;
+  } else if (cache->length < cache->capacity) {
+    index = cache->length++;
+  } else {
+    index = cache->tail;
+    ll__size_cache_unlink(cache, index);
+    ll__size_cache_unbucket(cache, index);
+    cache->stats.evictions++;
+  }
+
+  uint32_t* bucket = &cache->buckets[key & cache->bucket_mask];
+  cache->entries[index].key = key;
+  cache->entries[index].size = size;
+  cache->entries[index].bucket_next = *bucket;
+  *bucket = index;
+  ll__size_cache_push_front(cache, index);
+}
+
+// Remove `key` from the cache, if it is there
+void ll__size_cache_remove(ll__SizeCache* cache, uint64_t key) {
+  uint32_t* link = &cache->buckets[key & cache->bucket_mask];
+  while (*link != LL__NIL && cache->entries[*link].key != key) link = &cache->entries[*link].bucket_next;
+  if (*link == LL__NIL) return;
+
+  uint32_t index = *link;
+  *link = cache->entries[index].bucket_next;
+  ll__size_cache_unlink(cache, index);
+  cache->entries[index].bucket_next = cache->free;
+  cache->free = index;
+}
+
+// Mix a 64-bit value so that its low bits, which are used for bucketing,
+// depend on all of its bits
+uint64_t ll__mix64(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= UINT64_C(0xff51afd7ed558ccd);
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Hash a string and a letter spacing into a text cache key (FNV-1a, followed
+// by ll__mix64). Distinct strings collide with a probability of about 2^-64.
+uint64_t ll__text_key(const char* text, uint16_t letter_spacing) {
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+    hash = (hash ^ *c) * UINT64_C(0x100000001b3);
+  }
+  return ll__mix64(hash ^ (uint64_t)letter_spacing << 48);
+}
+
+// Return the image cache key of `image`. The mixing is invertible, so this
+// never collides.
+uint64_t ll__image_key(const LL_IMAGE_TYPE* image) {
+  return ll__mix64((uint64_t)(uintptr_t)image);
+}
+
+// measurement -----------------------------------------------------------------
+
 // Provided a single line of text and a pixel spacing between letters, return
-// the dimensions of that line in pixels.
-ll_Size ll__measure_text(const char* text, uint16_t letter_spacing);
+// the dimensions of that line in pixels. Its text key goes to `key`, unless
+// that is NULL.
+ll_Size ll__measure_text(ll_Context* ctx, const char* text, uint16_t letter_spacing, uint64_t* key) {
+  if (ctx->text_cache.capacity == 0) {
+    if (key != NULL) *key = ll__text_key(text, letter_spacing);
+    return ll__text_measurement_fn(text, letter_spacing);
+  }
+
+  uint64_t text_key = ll__text_key(text, letter_spacing);
+  if (key != NULL) *key = text_key;
+  ll_Size size;
+  if (!ll__size_cache_get(&ctx->text_cache, text_key, &size)) {
+    size = ll__text_measurement_fn(text, letter_spacing);
+    ll__size_cache_put(&ctx->text_cache, text_key, size);
+  }
+  return size;
+}
+
+// Set the cache entry for `key`, whether or not it is already cached
+void ll__size_cache_set(ll__SizeCache* cache, uint64_t key, ll_Size size) {
+  uint32_t index = cache->buckets[key & cache->bucket_mask];
+  while (index != LL__NIL && cache->entries[index].key != key) index = cache->entries[index].bucket_next;
+  if (index == LL__NIL) ll__size_cache_put(cache, key, size);
+  else cache->entries[index].size = size;
+}
 
 // Provided an instance of LL_IMAGE_TYPE, return the pixel size of that image
-ll_Size ll__measure_image(LL_IMAGE_TYPE* image);
+ll_Size ll__measure_image(ll_Context* ctx, LL_IMAGE_TYPE* image) {
+  if (ctx->image_cache.capacity == 0) return ll__image_measurement_fn(image);
+
+  uint64_t key = ll__image_key(image);
+  ll_Size size;
+  if (!ll__size_cache_get(&ctx->image_cache, key, &size)) {
+    size = ll__image_measurement_fn(image);
+    ll__size_cache_put(&ctx->image_cache, key, size);
+  }
+  return size;
+}
+
+// layout ----------------------------------------------------------------------
+
+// The computed layout of a single node. A node's pinhole is the point,
+// relative to its top-left corner, that its parent attaches it by: combinators
+// align their children's boxes as if each child's pinhole were its top-left
+// corner, and the root of a tree is drawn with its pinhole at the origin.
+// Combinators themselves always have their pinhole at their top-left corner.
+typedef struct {
+  ll_Size size;
+  ll_Vec2 pinhole;
+  // the number of render commands the node expands to
+  uint32_t command_count;
+  bool done;
+  // set by ll__prepare_tree on the nodes it has visited
+  bool seen;
+} ll__Layout;
+
+// Return the offset of an `inner` span aligned within an `outer` one. Both
+// ll_HorizAlign and ll_VertAlign count start, center, end from zero.
+int32_t ll__align(unsigned align, uint32_t outer, uint32_t inner) {
+  switch (align) {
+  case LL_HORIZ_ALIGN_CENTER: return ((int32_t)outer - (int32_t)inner) / 2;
+  case LL_HORIZ_ALIGN_RIGHT: return (int32_t)outer - (int32_t)inner;
+  default: return 0;
+  }
+}
+
+// Attach `anchor` at the origin and `placed` at `at`, and return the size of
+// the box enclosing both. The positions of the two children's top-left corners
+// relative to that box are written to `anchor_posn` and `placed_posn`.
+ll_Size ll__place(const ll__Layout* anchor, const ll__Layout* placed, ll_Vec2 at,
+                  ll_Vec2* anchor_posn, ll_Vec2* placed_posn) {
+  ll_Vec2 a = {-anchor->pinhole.x, -anchor->pinhole.y};
+  ll_Vec2 p = {at.x - placed->pinhole.x, at.y - placed->pinhole.y};
+  int32_t min_x = a.x < p.x ? a.x : p.x;
+  int32_t min_y = a.y < p.y ? a.y : p.y;
+  int32_t max_x = a.x + (int32_t)anchor->size.width;
+  int32_t max_y = a.y + (int32_t)anchor->size.height;
+  if (max_x < p.x + (int32_t)placed->size.width) max_x = p.x + (int32_t)placed->size.width;
+  if (max_y < p.y + (int32_t)placed->size.height) max_y = p.y + (int32_t)placed->size.height;
+
+  *anchor_posn = (ll_Vec2){a.x - min_x, a.y - min_y};
+  *placed_posn = (ll_Vec2){p.x - min_x, p.y - min_y};
+  return (ll_Size){(uint32_t)(max_x - min_x), (uint32_t)(max_y - min_y)};
+}
+
+// Compute the positions of both children of a binary node relative to the
+// node's top-left corner, returning the node's size.
+ll_Size ll__place_children(uint8_t tag, const ll__BinaryPayload* payload,
+                           const ll__Layout* first, const ll__Layout* second,
+                           ll_Vec2* first_posn, ll_Vec2* second_posn) {
+  ll_Size fs = first->size, ss = second->size;
+
+  switch (tag) {
+  case LL__NODE_TYPE_ABOVE: {
+    ll_AboveConfig conf = *LL__PAYLOAD_CONFIG(payload, ll_AboveConfig);
+    ll_Vec2 at = {ll__align(conf.align_h, fs.width, ss.width) + conf.offset.x,
+                  (int32_t)fs.height + conf.offset.y};
+    return ll__place(first, second, at, first_posn, second_posn);
+  }
+  case LL__NODE_TYPE_BESIDE: {
+    ll_BesideConfig conf = *LL__PAYLOAD_CONFIG(payload, ll_BesideConfig);
+    ll_Vec2 at = {(int32_t)fs.width + conf.offset.x,
+                  ll__align(conf.align_v, fs.height, ss.height) + conf.offset.y};
+    return ll__place(first, second, at, first_posn, second_posn);
+  }
+  case LL__NODE_TYPE_OVERLAY: {
+    // the second child is the anchor, since the first is drawn on top of it
+    ll_OverlayConfig conf = *LL__PAYLOAD_CONFIG(payload, ll_OverlayConfig);
+    ll_Vec2 at = {ll__align(conf.align_h, ss.width, fs.width) + conf.offset.x,
+                  ll__align(conf.align_v, ss.height, fs.height) + conf.offset.y};
+    return ll__place(second, first, at, second_posn, first_posn);
+  }
+  default:
+    *first_posn = *second_posn = (ll_Vec2){0, 0};
+    return (ll_Size){0, 0};
+  }
+}
+
+// The box around the children of a span node placed so far, relative to the
+// first child's pinhole, and the point that the next child is aligned to
+typedef struct {
+  ll_Vec2 min;
+  ll_Vec2 max;
+  ll_Vec2 anchor;
+} ll__SpanBox;
+
+// Place `child` after the children of a span node already in `box`, just as
+// a binary node would place it against a node holding all of them, and return
+// the position of its top-left corner relative to the first child's pinhole
+ll_Vec2 ll__span_place(uint8_t tag, const ll__SpanPayload* payload, ll__SpanBox* box, const ll__Layout* child,
+                       bool first) {
+  ll_Vec2 posn = {-child->pinhole.x, -child->pinhole.y};
+  if (first) {
+    *box = (ll__SpanBox){posn, {posn.x + (int32_t)child->size.width, posn.y + (int32_t)child->size.height}, {0, 0}};
+    return posn;
+  }
+
+  uint32_t width = (uint32_t)(box->max.x - box->min.x), height = (uint32_t)(box->max.y - box->min.y);
+  if (tag == LL__NODE_TYPE_ABOVE_N) {
+    ll_AboveConfig conf = *LL__PAYLOAD_CONFIG(payload, ll_AboveConfig);
+    posn.x += box->anchor.x + ll__align(conf.align_h, width, child->size.width) + conf.offset.x;
+    posn.y += box->anchor.y + (int32_t)height + conf.offset.y;
+  } else {
+    ll_BesideConfig conf = *LL__PAYLOAD_CONFIG(payload, ll_BesideConfig);
+    posn.x += box->anchor.x + (int32_t)width + conf.offset.x;
+    posn.y += box->anchor.y + ll__align(conf.align_v, height, child->size.height) + conf.offset.y;
+  }
+  if (box->min.x > posn.x) box->min.x = posn.x;
+  if (box->min.y > posn.y) box->min.y = posn.y;
+  if (box->max.x < posn.x + (int32_t)child->size.width) box->max.x = posn.x + (int32_t)child->size.width;
+  if (box->max.y < posn.y + (int32_t)child->size.height) box->max.y = posn.y + (int32_t)child->size.height;
+  // the node holding every child so far has its pinhole at its top-left corner
+  box->anchor = box->min;
+  return posn;
+}
+
+bool ll__intersects(ll_Bounds a, ll_Bounds b) {
+  return (int64_t)a.posn.x < (int64_t)b.posn.x + b.size.width && (int64_t)b.posn.x < (int64_t)a.posn.x + a.size.width &&
+         (int64_t)a.posn.y < (int64_t)b.posn.y + b.size.height && (int64_t)b.posn.y < (int64_t)a.posn.y + a.size.height;
+}
+
+// Return whether `inner` lies entirely within `outer`
+bool ll__contains(ll_Bounds outer, ll_Bounds inner) {
+  return inner.posn.x >= outer.posn.x && inner.posn.y >= outer.posn.y &&
+         (int64_t)inner.posn.x + inner.size.width <= (int64_t)outer.posn.x + outer.size.width &&
+         (int64_t)inner.posn.y + inner.size.height <= (int64_t)outer.posn.y + outer.size.height;
+}
+
+// Return whether a node with box `bounds` shows within `region`. Boxes without
+// area (like empty text) never overlap anything, but still count when they lie
+// within the region, so that culling doesn't depend on where they sit in it.
+bool ll__visible(ll_Bounds bounds, ll_Bounds region) {
+  bool degenerate = bounds.size.width == 0 || bounds.size.height == 0;
+  return ll__intersects(bounds, region) || (degenerate && ll__contains(region, bounds));
+}
+
+// Resolve the handle of a child of the node at `parent` to an index. A handle
+// is valid exactly when it is from the current generation and names a node
+// created before its parent, which both come down to one unsigned compare
+// against `base`, the current generation's first handle. Invalid handles are
+// resolved to the empty leaf, so that the walk can carry on without branching,
+// and recorded in `stale` so that the result is refused afterwards.
+uint32_t ll__resolve(ll_NodeHandle handle, uint32_t parent, uint32_t base, uint32_t* stale) {
+  uint32_t index = handle - base;
+  uint32_t valid = index < parent;
+  *stale |= valid ^ 1;
+  return index & (0 - valid);
+}
+
+// Return the handles of the children of the span node at `index`, which are
+// followed by their positions
+ll_NodeHandle* ll__span_children(const ll__NodeArray* nodes, uint32_t index) {
+  uint32_t conf_size = nodes->tags[index] == LL__NODE_TYPE_ABOVE_N ? sizeof(ll_AboveConfig) : sizeof(ll_BesideConfig);
+  return (ll_NodeHandle*)(nodes->payloads + nodes->payload_offsets[index] + sizeof(ll__SpanPayload) + conf_size);
+}
+
+// Return the number of children of the node at `index`
+uint32_t ll__child_count(const ll__NodeArray* nodes, uint32_t index) {
+  switch (nodes->tags[index]) {
+  case LL__NODE_TYPE_ABOVE:
+  case LL__NODE_TYPE_BESIDE:
+  case LL__NODE_TYPE_OVERLAY:
+    return 2;
+  case LL__NODE_TYPE_MOVE_PINHOLE:
+  case LL__NODE_TYPE_RESET_PINHOLE:
+  case LL__NODE_TYPE_KEY:
+  case LL__NODE_TYPE_CLIP:
+    return 1;
+  case LL__NODE_TYPE_ABOVE_N:
+  case LL__NODE_TYPE_BESIDE_N:
+    return LL__PAYLOAD(nodes, index, ll__SpanPayload)->child_count;
+  default:
+    return 0;
+  }
+}
+
+// Return the index of child `i` of the node at `index`, validated with
+// ll__resolve
+uint32_t ll__child(const ll__NodeArray* nodes, uint32_t index, uint32_t i, uint32_t base, uint32_t* stale) {
+  ll_NodeHandle handle;
+  switch (nodes->tags[index]) {
+  case LL__NODE_TYPE_ABOVE:
+  case LL__NODE_TYPE_BESIDE:
+  case LL__NODE_TYPE_OVERLAY: {
+    const ll__BinaryPayload* payload = LL__PAYLOAD(nodes, index, ll__BinaryPayload);
+    handle = i == 0 ? payload->first_child : payload->second_child;
+    break;
+  }
+  case LL__NODE_TYPE_ABOVE_N:
+  case LL__NODE_TYPE_BESIDE_N:
+    handle = ll__span_children(nodes, index)[i];
+    break;
+  default:
+    handle = LL__PAYLOAD(nodes, index, ll__UnaryPayload)->child;
+    break;
+  }
+  return ll__resolve(handle, index, base, stale);
+}
+
+// subtree cache ---------------------------------------------------------------
+
+// Fold `size` bytes at `data` into an FNV-1a hash
+uint64_t ll__hash_bytes(uint64_t hash, const void* data, uint32_t size) {
+  for (uint32_t i = 0; i < size; i++) hash = (hash ^ ((const unsigned char*)data)[i]) * UINT64_C(0x100000001b3);
+  return hash;
+}
+
+// Record the structural hash of the node `handle`, just created with `conf_size`
+// bytes of configuration at `conf`, if the current context has a subtree cache
+void ll__hash_node(ll_NodeHandle handle, const void* conf, uint32_t conf_size) {
+  ll_Context* ctx = ll__current_context;
+  uint64_t* hashes = ctx->subtree_cache.hashes;
+  if (hashes == NULL) return;
+  const ll__NodeArray* nodes = &ctx->nodes;
+  uint32_t index = handle & LL__HANDLE_INDEX_MASK;
+  uint8_t tag = nodes->tags[index];
+  // mixing the tag in as a whole word keeps it apart from the configuration,
+  // which would otherwise cancel it out in the first byte
+  uint64_t hash = ll__hash_bytes(ll__mix64(UINT64_C(0xcbf29ce484222325) ^ tag), conf, conf_size);
+
+  switch (tag) {
+  case LL__NODE_TYPE_IMAGE: {
+    const ll__ImagePayload* image = LL__PAYLOAD(nodes, index, ll__ImagePayload);
+    hash = ll__hash_bytes(hash, &image->image_data, sizeof(image->image_data));
+    hash = ll__hash_bytes(hash, &image->image_size, sizeof(image->image_size));
+    break;
+  }
+  case LL__NODE_TYPE_TEXT: {
+    // the pointer counts too, since remembered render commands hold it
+    const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+    hash = ll__hash_bytes(hash, &text->text, sizeof(text->text));
+    hash ^= ll__text_key(text->text, (uint16_t)text->config.letter_spacing);
+    break;
+  }
+  default: {
+    uint32_t base = ctx->generation << LL_HANDLE_INDEX_BITS;
+    uint32_t stale = 0;
+    uint32_t count = ll__child_count(nodes, index);
+    for (uint32_t i = 0; i < count; i++) {
+      // mixing in each child in turn keeps the order of the children
+      uint32_t child = ll__child(nodes, index, i, base, &stale);
+      hash = ll__mix64(hash * UINT64_C(0x9e3779b97f4a7c15) ^ hashes[child]);
+      if (hashes[child] == 0) stale = 1;
+    }
+    if (stale) hash = 0;
+    break;
+  }
+  }
+  hashes[index] = hash != 0 || tag >= LL__NODE_TYPE_ABOVE ? hash : 1;
+}
+
+// Carve a subtree cache of `capacity` entries out of the arena, returning
+// false if it doesn't fit
+bool ll__subtree_cache_init(ll__SubtreeCache* cache, ll__Arena* arena, uint32_t max_nodes, uint32_t capacity) {
+  uint32_t table_size = 1;
+  while (table_size < 2 * (uint64_t)capacity) table_size <<= 1;
+  *cache = (ll__SubtreeCache){
+      .hashes = LL__ARENA_ALLOC(arena, uint64_t, max_nodes + 1),
+      .table = LL__ARENA_ALLOC(arena, uint32_t, table_size),
+      .table_mask = table_size - 1,
+      .capacity = capacity,
+  };
+  if (cache->hashes == NULL || cache->table == NULL) return false;
+  for (uint32_t i = 0; i < 2; i++) {
+    cache->frames[i].entries = LL__ARENA_ALLOC(arena, ll__SubtreeEntry, capacity);
+    cache->frames[i].commands = LL__ARENA_ALLOC(arena, ll_RenderCommand, capacity);
+    if (cache->frames[i].entries == NULL || cache->frames[i].commands == NULL) return false;
+  }
+  for (uint32_t i = 0; i < table_size; i++) cache->table[i] = LL__NIL;
+  return true;
+}
+
+// Return the index of the remembered entry for `hash`, or LL__NIL
+uint32_t ll__subtree_cache_find(const ll__SubtreeCache* cache, uint64_t hash) {
+  const ll__SubtreeEntry* entries = cache->frames[cache->current].entries;
+  uint32_t slot = (uint32_t)hash & cache->table_mask;
+  while (cache->table[slot] != LL__NIL && entries[cache->table[slot]].hash != hash) {
+    slot = (slot + 1) & cache->table_mask;
+  }
+  return cache->table[slot];
+}
+
+// Forget every remembered subtree
+void ll__subtree_cache_clear(ll__SubtreeCache* cache) {
+  for (uint32_t i = 0; i <= cache->table_mask; i++) cache->table[i] = LL__NIL;
+  cache->frames[cache->current].entry_count = 0;
+  cache->frames[cache->current].command_count = 0;
+}
+
+// Append an entry for a subtree drawn at `posn` to the frame being generated,
+// if there is room for it, returning its index or LL__NIL
+uint32_t ll__subtree_cache_append(ll__SubtreeCache* cache, ll__SubtreeEntry entry) {
+  ll__SubtreeFrame* next = &cache->frames[cache->current ^ 1];
+  if (next->entry_count == cache->capacity) {
+    cache->stats.evictions++;
+    return LL__NIL;
+  }
+  next->entries[next->entry_count] = entry;
+  return next->entry_count++;
+}
+
+// Make the frame being generated, which drew `cmds`, the one remembered, and
+// index it
+void ll__subtree_cache_commit(ll__SubtreeCache* cache, const ll_RenderCommandArray* cmds) {
+  ll__SubtreeFrame* next = &cache->frames[cache->current ^ 1];
+  next->command_count = cmds->length < cache->capacity ? cmds->length : cache->capacity;
+  memcpy(next->commands, cmds->internalArray, sizeof(ll_RenderCommand) * next->command_count);
+
+  for (uint32_t i = 0; i <= cache->table_mask; i++) cache->table[i] = LL__NIL;
+  cache->current ^= 1;
+  for (uint32_t i = 0; i < next->entry_count; i++) {
+    const ll__SubtreeEntry* entry = &next->entries[i];
+    if (entry->first_command + entry->command_count > next->command_count) {
+      cache->stats.evictions++;
+      continue;
+    }
+    uint32_t slot = (uint32_t)entry->hash & cache->table_mask;
+    while (cache->table[slot] != LL__NIL && next->entries[cache->table[slot]].hash != entry->hash) {
+      slot = (slot + 1) & cache->table_mask;
+    }
+    // repeated subtrees keep their first entry
+    if (cache->table[slot] == LL__NIL) cache->table[slot] = i;
+  }
+  cache->frames[cache->current ^ 1].entry_count = 0;
+}
+
+// Append the remembered render commands of the subtree at entry `hit`,
+// translated so that its top-left corner is at `posn` and rekeyed to `key`
+// where they inherited their key from above the subtree, to `cmds`. Commands
+// outside `viewport` or `clip` (either may be NULL) are culled just as
+// ll__emit_tree would have culled them: against the viewport, and against the
+// innermost clip, which inside the subtree's own clips already culled them
+// when they were recorded. Only a subtree drawn whole is carried over to the
+// frame being generated, along with its descendants.
+void ll__subtree_cache_splice(ll__SubtreeCache* cache, uint32_t hit, ll_RenderCommandArray* cmds, ll_Vec2 posn,
+                              uint64_t key, const ll_Bounds* viewport, const ll_Bounds* clip) {
+  const ll__SubtreeFrame* prev = &cache->frames[cache->current];
+  const ll__SubtreeEntry* entry = &prev->entries[hit];
+  ll_Vec2 delta = {posn.x - entry->posn.x, posn.y - entry->posn.y};
+  uint32_t first_command = cmds->length;
+  ll_Bounds bounds = {posn, entry->size};
+  bool whole = (viewport == NULL || ll__contains(*viewport, bounds)) && (clip == NULL || ll__contains(*clip, bounds));
+
+  // the number of the subtree's own clips around the current command
+  uint32_t depth = 0;
+  for (uint32_t i = 0; i < entry->command_count; i++) {
+    ll_RenderCommand cmd = prev->commands[entry->first_command + i];
+    cmd.bounds.posn.x += delta.x;
+    cmd.bounds.posn.y += delta.y;
+    if (cmd.key == entry->key) cmd.key = key;
+    if (!whole && cmd.tag != LL_RENDER_DATA_TAG_SCISSOR_END &&
+        ((viewport != NULL && !ll__visible(cmd.bounds, *viewport)) ||
+         (depth == 0 && clip != NULL && !ll__visible(cmd.bounds, *clip)))) {
+      // skip a culled clip along with everything in it
+      for (uint32_t open = cmd.tag == LL_RENDER_DATA_TAG_SCISSOR_START; open > 0;) {
+        ll_RenderDataTag tag = prev->commands[entry->first_command + ++i].tag;
+        open += (tag == LL_RENDER_DATA_TAG_SCISSOR_START) - (tag == LL_RENDER_DATA_TAG_SCISSOR_END);
+      }
+      continue;
+    }
+    depth += (cmd.tag == LL_RENDER_DATA_TAG_SCISSOR_START) - (cmd.tag == LL_RENDER_DATA_TAG_SCISSOR_END);
+    cmds->internalArray[cmds->length++] = cmd;
+  }
+  if (!whole) return;
+
+  uint32_t end = entry->first_command + entry->command_count;
+  for (uint32_t i = hit; i < prev->entry_count && (i == hit || prev->entries[i].first_command < end); i++) {
+    ll__SubtreeEntry moved = prev->entries[i];
+    moved.first_command = moved.first_command - entry->first_command + first_command;
+    moved.posn = (ll_Vec2){moved.posn.x + delta.x, moved.posn.y + delta.y};
+    if (moved.key == entry->key) moved.key = key;
+    ll__subtree_cache_append(cache, moved);
+  }
+}
+
+// hash-consing ----------------------------------------------------------------
+
+// Return whether the nodes at `a` and `b`, which have the same tag and
+// `payload_size` bytes of payload, are identical
+bool ll__same_node(const ll__NodeArray* nodes, uint32_t a, uint32_t b, uint32_t payload_size) {
+  if (nodes->tags[a] == LL__NODE_TYPE_TEXT) {
+    const ll__TextPayload* text_a = LL__PAYLOAD(nodes, a, ll__TextPayload);
+    const ll__TextPayload* text_b = LL__PAYLOAD(nodes, b, ll__TextPayload);
+    return text_a->config.letter_spacing == text_b->config.letter_spacing &&
+           (text_a->text == text_b->text || strcmp(text_a->text, text_b->text) == 0);
+  }
+  return memcmp(nodes->payloads + nodes->payload_offsets[a], nodes->payloads + nodes->payload_offsets[b],
+                payload_size) == 0;
+}
+
+// Finish recording the node `handle`, just created with `conf_size` bytes of
+// configuration at `conf`. With hash-consing, a node identical to an earlier
+// one is taken back off the node array and the earlier handle returned.
+ll_NodeHandle ll__finish_node(ll_NodeHandle handle, const void* conf, uint32_t conf_size) {
+  ll_Context* ctx = ll__current_context;
+  ll__NodeArray* nodes = &ctx->nodes;
+  uint32_t index = handle & LL__HANDLE_INDEX_MASK;
+  uint8_t tag = nodes->tags[index];
+
+  ll__InternTable* interned = &ctx->interned;
+  if (interned->handles != NULL) {
+    uint32_t offset = nodes->payload_offsets[index];
+    uint32_t payload_size = nodes->payload_length - offset;
+    uint64_t hash;
+    if (tag == LL__NODE_TYPE_TEXT) {
+      const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+      hash = ll__text_key(text->text, (uint16_t)text->config.letter_spacing);
+    } else {
+      hash = ll__hash_bytes(UINT64_C(0xcbf29ce484222325), nodes->payloads + offset, payload_size);
+    }
+    hash = ll__mix64(hash ^ tag);
+
+    // every live slot holds a node created before this one
+    uint32_t base = ctx->generation << LL_HANDLE_INDEX_BITS;
+    uint32_t slot = (uint32_t)hash & interned->mask;
+    for (uint32_t other; (other = interned->handles[slot] - base) < index;) {
+      if (nodes->tags[other] == tag && ll__same_node(nodes, other, index, payload_size)) {
+        nodes->length = index;
+        nodes->payload_length = offset;
+        return interned->handles[slot];
+      }
+      slot = (slot + 1) & interned->mask;
+    }
+    interned->handles[slot] = handle;
+  }
+
+  if (tag == LL__NODE_TYPE_CLIP) nodes->clip_count++;
+  ll__hash_node(handle, conf, conf_size);
+  return handle;
+}
+
+// layout passes --------------------------------------------------------------
+
+// Both passes walk the tree with an explicit stack in the arena instead of
+// recursing, so that deep trees (like a long LL_FOLDL1 chain) never depend on
+// the size of the call stack. Laying out a tree of n nodes takes n ll__Layouts
+// (24 bytes each) and n + 1 ll__StackEntries (16 bytes each) of scratch, and
+// the sizing pass reuses the stack's memory for its own n pairs of indices.
+
+typedef struct {
+  uint32_t index;
+  // the position of the node's top-left corner
+  ll_Vec2 posn;
+  // the index of the nearest ll_key node above the node, or zero (the index of
+  // the empty leaf) if there is none
+  uint32_t keyed;
+} ll__StackEntry;
+
+// Set on an emission stack entry that draws the next child of a span node
+#define LL__EXPANDED (UINT32_C(1) << 31)
+
+// The most jobs parallel layout splits a tree into, per worker
+#define LL__JOBS_PER_WORKER 8
+
+#ifndef __STDC_NO_ATOMICS__
+typedef _Atomic uint32_t ll__JobCursor;
+#define LL__CLAIM(cursor) atomic_fetch_add_explicit((cursor), 1, memory_order_relaxed)
+#else
+// without atomics, each worker sticks to its own jobs
+typedef uint32_t ll__JobCursor;
+#define LL__CLAIM(cursor) ((*(cursor))++)
+#endif
+
+// A subtree laid out and drawn by one of the workers of parallel layout
+typedef struct {
+  uint32_t root;
+  // the job's own sizing and emission stack
+  ll__StackEntry* stack;
+  uint32_t stale;
+  // filled in by ll__emit_tree: the slice of the render command array the
+  // job draws into, and where and under which ll_key node its root goes
+  uint32_t first_command;
+  ll_Vec2 posn;
+  uint32_t keyed;
+} ll__ParallelJob;
+
+typedef struct {
+  ll_Context* ctx;
+  ll__Layout* layouts;
+  uint32_t base;
+  ll__ParallelJob* jobs;
+  uint32_t job_count;
+  // the index in `jobs` of the job each node roots, or LL__NIL
+  uint32_t* job_of;
+  // each worker starts on the jobs from its cursor up to its end
+  ll__JobCursor* cursors;
+  uint32_t* ends;
+  // NULL while sizing, and the array being drawn into while drawing
+  ll_RenderCommandArray* cmds;
+} ll__ParallelGen;
+
+// Marks a node that ll__emit_sweep hasn't placed yet
+#define LL__UNPLACED UINT32_MAX
+
+// Marks an emission stack entry that closes a clip. Its `keyed` holds the
+// index of the enclosing clip's SCISSOR_START command, or LL__NIL.
+#define LL__CLIP_END UINT32_MAX
+// Marks an emission stack entry that closes a subtree recorded in the subtree
+// cache. Its `keyed` holds the index of the subtree's entry, or LL__NIL.
+#define LL__CACHE_END (UINT32_MAX - 1)
+
+// Measure the `leaf_count` text leaves at `leaves` with the batch measurement
+// function, writing their layouts to `layouts` and marking them done. Leaves
+// found in the text cache are left out of the batch. Returns false if the
+// arena can't hold the batch.
+bool ll__measure_text_batch(ll_Context* ctx, const ll__NodeArray* nodes, ll__Layout* layouts, const uint32_t* leaves,
+                            uint32_t leaf_count) {
+  const char** texts = LL__ARENA_ALLOC(&ctx->arena, const char*, leaf_count);
+  uint16_t* letter_spacings = LL__ARENA_ALLOC(&ctx->arena, uint16_t, leaf_count);
+  ll_Size* sizes = LL__ARENA_ALLOC(&ctx->arena, ll_Size, leaf_count);
+  uint32_t* indices = LL__ARENA_ALLOC(&ctx->arena, uint32_t, leaf_count);
+  if (texts == NULL || letter_spacings == NULL || sizes == NULL || indices == NULL) return false;
+
+  bool cached = ctx->text_cache.capacity > 0;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < leaf_count; i++) {
+    uint32_t index = leaves[i];
+    const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+    uint16_t letter_spacing = (uint16_t)text->config.letter_spacing;
+    layouts[index] = (ll__Layout){.command_count = 1, .done = true};
+    uint64_t key = 0;
+    if (cached || nodes->text_keys != NULL) key = ll__text_key(text->text, letter_spacing);
+    if (nodes->text_keys != NULL) nodes->text_keys[index] = key;
+    if (cached && ll__size_cache_get(&ctx->text_cache, key, &layouts[index].size)) continue;
+    texts[count] = text->text;
+    letter_spacings[count] = letter_spacing;
+    indices[count] = index;
+    count++;
+  }
+
+  if (count > 0) ll__text_batch_measurement_fn(texts, letter_spacings, sizes, count);
+  for (uint32_t i = 0; i < count; i++) {
+    layouts[indices[i]].size = sizes[i];
+    if (cached) ll__size_cache_set(&ctx->text_cache, ll__text_key(texts[i], letter_spacings[i]), sizes[i]);
+  }
+  return true;
+}
+
+// Measure the `leaf_count` text leaves at `leaves` with the glyph measurement
+// function, writing their layouts to `layouts`, marked done, and the glyph
+// offsets to the arena. This comes before the rest of the layout, which may
+// rewind the arena.
+void ll__measure_glyphs(ll_Context* ctx, const ll__NodeArray* nodes, ll__Layout* layouts, const uint32_t* leaves,
+                        uint32_t leaf_count) {
+  for (uint32_t i = 0; i < leaf_count; i++) {
+    uint32_t index = leaves[i];
+    const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+    int32_t* glyph_x = LL__ARENA_ALLOC(&ctx->arena, int32_t, strlen(text->text));
+    ll_Size size = ll__glyph_measurement_fn(text->text, (uint16_t)text->config.letter_spacing, glyph_x);
+    layouts[index] = (ll__Layout){.size = size, .command_count = 1, .done = true};
+    nodes->glyph_x[index] = glyph_x;
+    if (nodes->text_keys != NULL) {
+      nodes->text_keys[index] = ll__text_key(text->text, (uint16_t)text->config.letter_spacing);
+    }
+  }
+}
+
+// Compute the layout of the node at `index`, whose children are already laid
+// out. Text leaves measured ahead, in a batch or by glyph, are never passed
+// here, since they're already done.
+void ll__measure_node(ll_Context* ctx, const ll__NodeArray* nodes, ll__Layout* layouts, uint32_t index,
+                      uint32_t base, uint32_t* stale) {
+  ll__Layout* layout = &layouts[index];
+  uint8_t tag = nodes->tags[index];
+
+  switch (tag) {
+  case LL__NODE_TYPE_EMPTY:
+    *layout = (ll__Layout){0};
+    break;
+  case LL__NODE_TYPE_IMAGE: {
+    const ll__ImagePayload* image = LL__PAYLOAD(nodes, index, ll__ImagePayload);
+    ll_Size size = image->image_size;
+    if (size.width == 0 && size.height == 0) size = ll__measure_image(ctx, image->image_data);
+    *layout = (ll__Layout){.size = size, .command_count = 1};
+    break;
+  }
+  case LL__NODE_TYPE_TEXT: {
+    const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+    uint64_t* key = nodes->text_keys != NULL ? &nodes->text_keys[index] : NULL;
+    ll_Size size = ll__measure_text(ctx, text->text, (uint16_t)text->config.letter_spacing, key);
+    *layout = (ll__Layout){.size = size, .command_count = 1};
+    break;
+  }
+  case LL__NODE_TYPE_ABOVE:
+  case LL__NODE_TYPE_BESIDE:
+  case LL__NODE_TYPE_OVERLAY: {
+    const ll__BinaryPayload* payload = LL__PAYLOAD(nodes, index, ll__BinaryPayload);
+    const ll__Layout* first = &layouts[ll__resolve(payload->first_child, index, base, stale)];
+    const ll__Layout* second = &layouts[ll__resolve(payload->second_child, index, base, stale)];
+    ll_Vec2 first_posn, second_posn;
+    layout->size = ll__place_children(tag, payload, first, second, &first_posn, &second_posn);
+    layout->pinhole = (ll_Vec2){0, 0};
+    layout->command_count = first->command_count + second->command_count;
+    break;
+  }
+  case LL__NODE_TYPE_MOVE_PINHOLE: {
+    const ll__UnaryPayload* payload = LL__PAYLOAD(nodes, index, ll__UnaryPayload);
+    ll_Vec2 offset = LL__PAYLOAD_CONFIG(payload, ll_MovePinholeConfig)->offset;
+    *layout = layouts[ll__resolve(payload->child, index, base, stale)];
+    layout->pinhole.x += offset.x;
+    layout->pinhole.y += offset.y;
+    break;
+  }
+  case LL__NODE_TYPE_RESET_PINHOLE: {
+    const ll__UnaryPayload* payload = LL__PAYLOAD(nodes, index, ll__UnaryPayload);
+    *layout = layouts[ll__resolve(payload->child, index, base, stale)];
+    layout->pinhole = (ll_Vec2){0, 0};
+    break;
+  }
+  case LL__NODE_TYPE_KEY:
+    *layout = layouts[ll__resolve(LL__PAYLOAD(nodes, index, ll__UnaryPayload)->child, index, base, stale)];
+    break;
+  case LL__NODE_TYPE_CLIP: {
+    const ll__UnaryPayload* payload = LL__PAYLOAD(nodes, index, ll__UnaryPayload);
+    uint32_t command_count = layouts[ll__resolve(payload->child, index, base, stale)].command_count;
+    *layout = (ll__Layout){
+        .size = LL__PAYLOAD_CONFIG(payload, ll_ClipConfig)->size,
+        .command_count = command_count + 2,
+    };
+    break;
+  }
+  case LL__NODE_TYPE_ABOVE_N:
+  case LL__NODE_TYPE_BESIDE_N: {
+    const ll__SpanPayload* payload = LL__PAYLOAD(nodes, index, ll__SpanPayload);
+    ll_NodeHandle* children = ll__span_children(nodes, index);
+    ll_Vec2* posns = (ll_Vec2*)(children + payload->child_count);
+    // set by the first child; spans always have two or more
+    ll__SpanBox box = {0};
+    uint32_t command_count = 0;
+    for (uint32_t i = 0; i < payload->child_count; i++) {
+      const ll__Layout* child = &layouts[ll__resolve(children[i], index, base, stale)];
+      posns[i] = ll__span_place(tag, payload, &box, child, i == 0);
+      command_count += child->command_count;
+    }
+    for (uint32_t i = 0; i < payload->child_count; i++) {
+      posns[i] = (ll_Vec2){posns[i].x - box.min.x, posns[i].y - box.min.y};
+    }
+    *layout = (ll__Layout){
+        .size = {(uint32_t)(box.max.x - box.min.x), (uint32_t)(box.max.y - box.min.y)},
+        .command_count = command_count,
+    };
+    break;
+  }
+  }
+  layout->done = true;
+}
+
+// Take the layout of the combinator at `index` from the subtree cache if it's
+// remembered there, noting the entry in `hits`. Returns false on a miss.
+bool ll__recall_subtree(ll__SubtreeCache* cache, const ll__NodeArray* nodes, ll__Layout* layouts,
+                        uint32_t* hits, uint32_t index) {
+  if (nodes->tags[index] < LL__NODE_TYPE_ABOVE) return false;
+  uint64_t hash = cache->hashes[index];
+  uint32_t hit = hash != 0 ? ll__subtree_cache_find(cache, hash) : LL__NIL;
+  const ll__SubtreeEntry* entry = hit != LL__NIL ? &cache->frames[cache->current].entries[hit] : NULL;
+  if (entry == NULL || entry->tag != nodes->tags[index] || entry->child_count != ll__child_count(nodes, index)) {
+    cache->stats.misses++;
+    return false;
+  }
+  cache->stats.hits++;
+  layouts[index] = (ll__Layout){
+      .size = entry->size,
+      .pinhole = entry->pinhole,
+      .command_count = entry->command_count,
+      .done = true,
+      .seen = true,
+  };
+  hits[index] = hit;
+  return true;
+}
+
+// Walk `root` and its descendants top-down ahead of ll__measure_tree. With a
+// subtree cache (`hits` isn't NULL), every combinator remembered there is
+// taken from it, noting the entry in `hits`, and not descended into. The text
+// leaves reached go to `leaves`, unless it is NULL, and their number is
+// returned. `stack` and `leaves` each need room for root + 1 indices, since
+// each node is pushed at most once.
+uint32_t ll__prepare_tree(ll__SubtreeCache* cache, const ll__NodeArray* nodes, ll__Layout* layouts, uint32_t* stack,
+                          uint32_t* leaves, uint32_t* hits, uint32_t root, uint32_t base, uint32_t* stale) {
+  for (uint32_t i = 0; i <= root; i++) layouts[i].seen = false;
+  uint32_t top = 0, leaf_count = 0;
+  stack[top++] = root;
+  layouts[root].seen = true;
+
+  while (top > 0) {
+    uint32_t index = stack[--top];
+    if (hits != NULL && ll__recall_subtree(cache, nodes, layouts, hits, index)) continue;
+    if (leaves != NULL && nodes->tags[index] == LL__NODE_TYPE_TEXT) leaves[leaf_count++] = index;
+    uint32_t count = ll__child_count(nodes, index);
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t child = ll__child(nodes, index, i, base, stale);
+      if (!layouts[child].seen) {
+        layouts[child].seen = true;
+        stack[top++] = child;
+      }
+    }
+  }
+  return leaf_count;
+}
+
+// Lay out `root` and its descendants bottom-up, validating every child handle
+// along the way with ll__resolve. `stack` holds a pair of indices per node on
+// the current path, the node and its next child to visit, so it needs room
+// for 2 * (root + 1) indices. Nodes already done (taken from the subtree cache
+// by ll__prepare_tree, or text leaves measured ahead) aren't visited.
+void ll__measure_tree(ll_Context* ctx, const ll__NodeArray* nodes, ll__Layout* layouts, uint32_t* stack,
+                      uint32_t root, uint32_t base, uint32_t* stale) {
+  if (layouts[root].done) return;
+  uint32_t top = 0;
+  stack[top++] = root;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    uint32_t index = stack[top - 2];
+    uint32_t next = stack[top - 1];
+
+    // descend into the next child that isn't laid out yet, so that leaves are
+    // measured in order
+    uint32_t count = ll__child_count(nodes, index);
+    uint32_t child = 0;
+    while (next < count && layouts[child = ll__child(nodes, index, next, base, stale)].done) next++;
+    if (next < count) {
+      stack[top - 1] = next + 1;
+      stack[top++] = child;
+      stack[top++] = 0;
+    } else {
+      top -= 2;
+      ll__measure_node(ctx, nodes, layouts, index, base, stale);
+    }
+  }
+}
+
+// Return the render command for the image or text leaf at `index`, under the
+// ll_key node at `keyed` (or zero)
+ll_RenderCommand ll__leaf_command(const ll__NodeArray* nodes, uint32_t index, ll_Bounds bounds, uint32_t keyed) {
+  uint64_t key = ll__node_key(nodes, keyed);
+  if (nodes->tags[index] == LL__NODE_TYPE_IMAGE) {
+    return (ll_RenderCommand){
+        .bounds = bounds,
+        .tag = LL_RENDER_DATA_TAG_IMAGE,
+        .render_data.image_render_data = {
+            .imageData = LL__PAYLOAD(nodes, index, ll__ImagePayload)->image_data,
+        },
+        .key = key,
+    };
+  }
+  const ll__TextPayload* text = LL__PAYLOAD(nodes, index, ll__TextPayload);
+  return (ll_RenderCommand){
+      .bounds = bounds,
+      .tag = LL_RENDER_DATA_TAG_TEXT,
+      .render_data.text_render_data = {
+          .text = text->text,
+          .letter_spacing = text->config.letter_spacing,
+          .glyph_x = nodes->glyph_x != NULL ? nodes->glyph_x[index] : NULL,
+          .text_hash = nodes->text_keys != NULL ? nodes->text_keys[index] : 0,
+      },
+      .key = key,
+  };
+}
+
+// Marks an emission stack entry whose node ll__emit_special has to see before
+// it's drawn, which is every node while any of its features are in use
+#define LL__CHECKED (UINT32_C(1) << 30)
+
+// Handle an emission stack entry with LL__CHECKED or a higher bit set for
+// ll__emit_tree: the markers that close a clip or a recorded subtree, the next
+// child of a span node, and then everything it does for a node beyond drawing
+// it: culling it against the viewport and the innermost clip (whose
+// SCISSOR_START command is `*clip`), handing it to a parallel job, and
+// splicing it in from or recording it in the subtree cache. Returns whether
+// the node of `entry`, with its mark cleared, is still to be drawn.
+bool ll__emit_special(const ll__NodeArray* nodes, const ll__Layout* layouts, ll__StackEntry* stack, uint32_t* top,
+                      ll__SubtreeCache* cache, const uint32_t* hits, ll__ParallelGen* parallel,
+                      const ll_Bounds* viewport, ll_RenderCommandArray* cmds, uint32_t* clip,
+                      ll__StackEntry* entry) {
+  if (entry->index == LL__CLIP_END) {
+    ll_RenderCommand end = cmds->internalArray[*clip];
+    end.tag = LL_RENDER_DATA_TAG_SCISSOR_END;
+    cmds->internalArray[cmds->length++] = end;
+    *clip = entry->keyed;
+    return false;
+  }
+  if (entry->index == LL__CACHE_END) {
+    // clips inside the subtree may have left out some of its commands
+    if (entry->keyed != LL__NIL) {
+      ll__SubtreeEntry* recorded = &cache->frames[cache->current ^ 1].entries[entry->keyed];
+      recorded->command_count = cmds->length - recorded->first_command;
+    }
+    return false;
+  }
+  if (entry->index & LL__EXPANDED) {
+    uint32_t index = entry->index & ~(LL__EXPANDED | LL__CHECKED);
+    ll__SpanPayload* payload = (ll__SpanPayload*)(nodes->payloads + nodes->payload_offsets[index]);
+    ll_NodeHandle* children = ll__span_children(nodes, index);
+    ll_Vec2 posn = ((ll_Vec2*)(children + payload->child_count))[payload->next_child];
+    uint32_t child_index = (children[payload->next_child++] & LL__HANDLE_INDEX_MASK) | (entry->index & LL__CHECKED);
+    if (payload->next_child < payload->child_count) stack[(*top)++] = *entry;
+    stack[(*top)++] = (ll__StackEntry){child_index, {entry->posn.x + posn.x, entry->posn.y + posn.y}, entry->keyed};
+    return false;
+  }
+
+  uint32_t index = entry->index &= ~LL__CHECKED;
+  uint8_t tag = nodes->tags[index];
+  ll_Bounds bounds = {entry->posn, layouts[index].size};
+  if (viewport != NULL && !ll__visible(bounds, *viewport)) return false;
+  if (*clip != LL__NIL && !ll__visible(bounds, cmds->internalArray[*clip].bounds)) return false;
+
+  if (parallel != NULL && parallel->job_of[index] != LL__NIL) {
+    ll__ParallelJob* job = &parallel->jobs[parallel->job_of[index]];
+    job->first_command = cmds->length;
+    job->posn = entry->posn;
+    job->keyed = entry->keyed;
+    cmds->length += layouts[index].command_count;
+    return false;
+  }
+
+  if (hits != NULL && tag >= LL__NODE_TYPE_ABOVE) {
+    if (hits[index] != LL__NIL) {
+      ll_Bounds clip_bounds = *clip != LL__NIL ? cmds->internalArray[*clip].bounds : (ll_Bounds){0};
+      ll__subtree_cache_splice(cache, hits[index], cmds, entry->posn, ll__node_key(nodes, entry->keyed), viewport,
+                               *clip != LL__NIL ? &clip_bounds : NULL);
+      return false;
+    }
+    if ((viewport == NULL || ll__contains(*viewport, bounds)) &&
+        (*clip == LL__NIL || ll__contains(cmds->internalArray[*clip].bounds, bounds))) {
+      uint32_t recorded = ll__subtree_cache_append(cache, (ll__SubtreeEntry){
+          .hash = cache->hashes[index],
+          .key = ll__node_key(nodes, entry->keyed),
+          .tag = tag,
+          .child_count = ll__child_count(nodes, index),
+          .size = layouts[index].size,
+          .pinhole = layouts[index].pinhole,
+          .posn = entry->posn,
+          .first_command = cmds->length,
+      });
+      stack[(*top)++] = (ll__StackEntry){LL__CACHE_END, {0, 0}, recorded};
+    }
+  }
+  return true;
+}
+
+// Append the render commands for `root`, whose top-left corner is at `posn`,
+// top-down. Only called once ll__measure_tree has found every handle in the
+// tree valid, so handles are simply masked down to indices. `stack` needs room
+// for root + 1 entries, since each node on it has a lower index than the last,
+// or twice that with a subtree cache. With a subtree cache, remembered subtrees
+// (per `hits`) are spliced in, and every combinator is recorded for the next
+// tree along with the number of commands it actually drew. With parallel
+// layout, the jobs of `parallel` are only given their slice of `cmds`, to be
+// drawn later. Subtrees outside the `viewport` (if any) or the innermost
+// enclosing clip are skipped, and only those entirely inside both are
+// recorded, since the others may be missing commands. Whether any of these
+// are in use is decided once: without them, nodes are pushed unmarked and the
+// walk takes a single untaken branch per node.
+void ll__emit_tree(const ll__NodeArray* nodes, const ll__Layout* layouts, ll__StackEntry* stack,
+                   ll__SubtreeCache* cache, const uint32_t* hits, ll__ParallelGen* parallel,
+                   const ll_Bounds* viewport, ll_RenderCommandArray* cmds, ll__StackEntry root) {
+  uint32_t checked = hits != NULL || parallel != NULL || viewport != NULL || nodes->clip_count > 0 ? LL__CHECKED : 0;
+  uint32_t top = 0;
+  stack[top++] = (ll__StackEntry){root.index | checked, root.posn, root.keyed};
+  // the SCISSOR_START command of the innermost clip
+  uint32_t clip = LL__NIL;
+
+  while (top > 0) {
+    ll__StackEntry entry = stack[--top];
+    if (entry.index >= LL__CHECKED) {
+      // copies, so that the hot variables never have their address taken
+      ll__StackEntry special = entry;
+      uint32_t special_top = top, special_clip = clip;
+      bool draw = ll__emit_special(nodes, layouts, stack, &special_top, cache, hits, parallel, viewport, cmds,
+                                   &special_clip, &special);
+      entry = special;
+      top = special_top;
+      clip = special_clip;
+      if (!draw) continue;
+    }
+
+    uint32_t index = entry.index;
+    uint8_t tag = nodes->tags[index];
+    ll_Bounds bounds = {entry.posn, layouts[index].size};
+    switch (tag) {
+    case LL__NODE_TYPE_EMPTY:
+      break;
+    case LL__NODE_TYPE_IMAGE:
+    case LL__NODE_TYPE_TEXT:
+      cmds->internalArray[cmds->length++] = ll__leaf_command(nodes, index, bounds, entry.keyed);
+      break;
+    case LL__NODE_TYPE_ABOVE:
+    case LL__NODE_TYPE_BESIDE:
+    case LL__NODE_TYPE_OVERLAY: {
+      const ll__BinaryPayload* payload = LL__PAYLOAD(nodes, index, ll__BinaryPayload);
+      uint32_t first_index = payload->first_child & LL__HANDLE_INDEX_MASK;
+      uint32_t second_index = payload->second_child & LL__HANDLE_INDEX_MASK;
+      ll_Vec2 first_posn, second_posn;
+      ll__place_children(tag, payload, &layouts[first_index], &layouts[second_index], &first_posn, &second_posn);
+      ll__StackEntry first = {first_index | checked, {entry.posn.x + first_posn.x, entry.posn.y + first_posn.y},
+                              entry.keyed};
+      ll__StackEntry second = {second_index | checked, {entry.posn.x + second_posn.x, entry.posn.y + second_posn.y},
+                               entry.keyed};
+      // push in reverse drawing order; an overlay draws its first child last,
+      // so that it ends up on top
+      if (tag == LL__NODE_TYPE_OVERLAY) {
+        stack[top++] = first;
+        stack[top++] = second;
+      } else {
+        stack[top++] = second;
+        stack[top++] = first;
+      }
+      break;
+    }
+    case LL__NODE_TYPE_MOVE_PINHOLE:
+    case LL__NODE_TYPE_RESET_PINHOLE:
+    case LL__NODE_TYPE_KEY: {
+      const ll__UnaryPayload* payload = LL__PAYLOAD(nodes, index, ll__UnaryPayload);
+      uint32_t keyed = tag == LL__NODE_TYPE_KEY ? index : entry.keyed;
+      stack[top++] = (ll__StackEntry){(payload->child & LL__HANDLE_INDEX_MASK) | checked, entry.posn, keyed};
+      break;
+    }
+    case LL__NODE_TYPE_CLIP: {
+      const ll__UnaryPayload* payload = LL__PAYLOAD(nodes, index, ll__UnaryPayload);
+      ll_Vec2 offset = LL__PAYLOAD_CONFIG(payload, ll_ClipConfig)->offset;
+      uint32_t child_index = payload->child & LL__HANDLE_INDEX_MASK;
+      ll_Vec2 pinhole = layouts[child_index].pinhole;
+      stack[top++] = (ll__StackEntry){LL__CLIP_END, {0, 0}, clip};
+      clip = cmds->length;
+      cmds->internalArray[cmds->length++] = (ll_RenderCommand){
+          .bounds = bounds,
+          .tag = LL_RENDER_DATA_TAG_SCISSOR_START,
+          .key = ll__node_key(nodes, entry.keyed),
+      };
+      ll_Vec2 child_posn = {entry.posn.x + offset.x - pinhole.x, entry.posn.y + offset.y - pinhole.y};
+      stack[top++] = (ll__StackEntry){child_index | checked, child_posn, entry.keyed};
+      break;
+    }
+    case LL__NODE_TYPE_ABOVE_N:
+    case LL__NODE_TYPE_BESIDE_N:
+      // the children are pushed one at a time, so that the stack grows by one
+      // entry per span node, just as it does per binary node
+      ((ll__SpanPayload*)(nodes->payloads + nodes->payload_offsets[index]))->next_child = 0;
+      stack[top++] = (ll__StackEntry){index | LL__EXPANDED | checked, entry.posn, entry.keyed};
+      break;
+    }
+  }
+}
+
+// Lay out every node up to `root` in a single forward sweep. Children always
+// have lower indices than their parents, so they're done by the time their
+// parents are reached. This also marks every node of `placements` unplaced,
+// ready for ll__emit_sweep.
+void ll__measure_sweep(ll_Context* ctx, const ll__NodeArray* nodes, ll__Layout* layouts,
+                       ll__StackEntry* placements, uint32_t root, uint32_t base, uint32_t* stale) {
+  for (uint32_t index = 0; index <= root; index++) {
+    // text leaves measured ahead are already done
+    if (!layouts[index].done) ll__measure_node(ctx, nodes, layouts, index, base, stale);
+    placements[index].index = LL__UNPLACED;
+  }
+}
+
+// Return whether a node of the tree under `root` has a stale or invalid
+// handle, marking the nodes of the tree as seen on the way. Parents come after
+// their children, so this takes one backward pass.
+uint32_t ll__tree_stale(const ll__NodeArray* nodes, ll__Layout* layouts, uint32_t root, uint32_t base) {
+  for (uint32_t index = 0; index < root; index++) layouts[index].seen = false;
+  layouts[root].seen = true;
+  uint32_t stale = 0;
+  for (uint32_t index = root + 1; index-- > 0;) {
+    if (!layouts[index].seen) continue;
+    uint32_t count = ll__child_count(nodes, index);
+    for (uint32_t i = 0; i < count; i++) layouts[ll__child(nodes, index, i, base, &stale)].seen = true;
+  }
+  return stale;
+}
+
+// Write the render commands for `root`, whose top-left corner is at `posn`,
+// in a single backward sweep. Parents have higher indices than their
+// children, so each node has been placed (given a position and the index of
+// its first render command) by the time the sweep reaches it. Returns false
+// if some node turns out to have two parents, in which case `cmds` is left
+// incomplete and the caller should fall back to ll__emit_tree.
+bool ll__emit_sweep(const ll__NodeArray* nodes, const ll__Layout* layouts, ll__StackEntry* placements,
+                    ll_RenderCommandArray* cmds, uint32_t root, ll_Vec2 posn) {
+  placements[root] = (ll__StackEntry){0, posn, 0};
+  uint32_t shared = 0;
+
+  for (uint32_t index = root + 1; index-- > 0;) {
+    ll__StackEntry placement = placements[index];
+    if (placement.index == LL__UNPLACED) continue;
+    uint8_t tag = nodes->tags[index];
+
+    switch (tag) {
+    case LL__NODE_TYPE_EMPTY:
+      break;
+    case LL__NODE_TYPE_IMAGE:
+    case LL__NODE_TYPE_TEXT:
+      cmds->internalArray[placement.index] =
+          ll__leaf_command(nodes, index, (ll_Bounds){placement.posn, layouts[index].size}, placement.keyed);
+      break;
+    case LL__NODE_TYPE_ABOVE:
+    case LL__NODE_TYPE_BESIDE:
+    case LL__NODE_TYPE_OVERLAY: {
+      const ll__BinaryPayload* payload = LL__PAYLOAD(nodes, index, ll__BinaryPayload);
+      uint32_t first_index = payload->first_child & LL__HANDLE_INDEX_MASK;
+      uint32_t second_index = payload->second_child & LL__HANDLE_INDEX_MASK;
+      ll_Vec2 first_posn, second_posn;
+      ll__place_children(tag, payload, &layouts[first_index], &layouts[second_index], &first_posn, &second_posn);
+      ll__StackEntry first = {placement.index, {placement.posn.x + first_posn.x, placement.posn.y + first_posn.y},
+                              placement.keyed};
+      ll__StackEntry second = {placement.index, {placement.posn.x + second_posn.x, placement.posn.y + second_posn.y},
+                               placement.keyed};
+      // an overlay draws its first child last, so that it ends up on top
+      if (tag == LL__NODE_TYPE_OVERLAY) {
+        first.index += layouts[second_index].command_count;
+      } else {
+        second.index += layouts[first_index].command_count;
+      }
+      shared |= placements[first_index].index != LL__UNPLACED;
+      placements[first_index] = first;
+      shared |= placements[second_index].index != LL__UNPLACED;
+      placements[second_index] = second;
+      break;
+    }
+    case LL__NODE_TYPE_MOVE_PINHOLE:
+    case LL__NODE_TYPE_RESET_PINHOLE:
+    case LL__NODE_TYPE_KEY: {
+      uint32_t child_index = LL__PAYLOAD(nodes, index, ll__UnaryPayload)->child & LL__HANDLE_INDEX_MASK;
+      shared |= placements[child_index].index != LL__UNPLACED;
+      placements[child_index] = placement;
+      if (tag == LL__NODE_TYPE_KEY) placements[child_index].keyed = index;
+      break;
+    }
+    case LL__NODE_TYPE_ABOVE_N:
+    case LL__NODE_TYPE_BESIDE_N: {
+      uint32_t count = LL__PAYLOAD(nodes, index, ll__SpanPayload)->child_count;
+      const ll_NodeHandle* children = ll__span_children(nodes, index);
+      const ll_Vec2* posns = (const ll_Vec2*)(children + count);
+      uint32_t first_command = placement.index;
+      for (uint32_t i = 0; i < count; i++) {
+        uint32_t child_index = children[i] & LL__HANDLE_INDEX_MASK;
+        shared |= placements[child_index].index != LL__UNPLACED;
+        placements[child_index] = (ll__StackEntry){
+            first_command, {placement.posn.x + posns[i].x, placement.posn.y + posns[i].y}, placement.keyed};
+        first_command += layouts[child_index].command_count;
+      }
+      break;
+    }
+    }
+  }
+
+  cmds->length = cmds->capacity;
+  return !shared;
+}
+
+// Return the next job for `worker`: the next of its own, or else one of
+// another worker's. Returns LL__NIL once there are none left.
+uint32_t ll__claim_job(ll__ParallelGen* gen, uint32_t worker) {
+  uint32_t worker_count = gen->ctx->parallel.worker_count;
+  for (uint32_t i = 0; i < worker_count; i++) {
+    uint32_t victim = (worker + i) % worker_count;
+#ifdef __STDC_NO_ATOMICS__
+    if (victim != worker) break;
+#endif
+    uint32_t job = LL__CLAIM(&gen->cursors[victim]);
+    if (job < gen->ends[victim]) return job;
+  }
+  return LL__NIL;
+}
+
+// Size or draw (see ll__ParallelGen) jobs until there are none left
+void ll__parallel_task(void* data, uint32_t worker) {
+  ll__ParallelGen* gen = data;
+  for (uint32_t index; (index = ll__claim_job(gen, worker)) != LL__NIL;) {
+    ll__ParallelJob* job = &gen->jobs[index];
+    if (gen->cmds == NULL) {
+      ll__measure_tree(gen->ctx, &gen->ctx->nodes, gen->layouts, (uint32_t*)job->stack, job->root, gen->base,
+                       &job->stale);
+    } else {
+      ll_RenderCommandArray cmds = {
+          .capacity = gen->layouts[job->root].command_count,
+          .internalArray = gen->cmds->internalArray + job->first_command,
+      };
+      ll__emit_tree(&gen->ctx->nodes, gen->layouts, job->stack, NULL, NULL, NULL, NULL, &cmds,
+                    (ll__StackEntry){job->root, job->posn, job->keyed});
+    }
+  }
+}
+
+// Hand the jobs out among the workers and run `gen` on them
+void ll__dispatch_jobs(ll__ParallelGen* gen) {
+  ll_ParallelConfig conf = gen->ctx->parallel;
+  for (uint32_t worker = 0; worker < conf.worker_count; worker++) {
+    gen->cursors[worker] = (uint32_t)((uint64_t)gen->job_count * worker / conf.worker_count);
+    gen->ends[worker] = (uint32_t)((uint64_t)gen->job_count * (worker + 1) / conf.worker_count);
+  }
+  conf.dispatch(ll__parallel_task, gen, conf.worker_count, conf.user_data);
+}
+
+// Lay out `root` like ll__measure_tree, but with its larger independent
+// subtrees split off as jobs and sized by the context's workers. Every leaf up
+// to `root` is measured first, on this thread. Returns NULL, having laid out
+// at most those leaves, if a combinator has two parents, if there's too little
+// to split up, or if the arena is exhausted.
+ll__ParallelGen* ll__measure_parallel(ll_Context* ctx, ll__Layout* layouts, ll__StackEntry* stack, uint32_t root,
+                                      uint32_t base, uint32_t* stale) {
+  const ll__NodeArray* nodes = &ctx->nodes;
+  uint32_t worker_count = ctx->parallel.worker_count;
+  uint32_t max_jobs = LL__JOBS_PER_WORKER * worker_count;
+  uintptr_t mark = ctx->arena.next_alloc;
+  ll__ParallelGen* gen = LL__ARENA_ALLOC(&ctx->arena, ll__ParallelGen, 1);
+  uint32_t* sizes = LL__ARENA_ALLOC(&ctx->arena, uint32_t, root + 1);
+  uint32_t* job_of = LL__ARENA_ALLOC(&ctx->arena, uint32_t, root + 1);
+  ll__ParallelJob* jobs = LL__ARENA_ALLOC(&ctx->arena, ll__ParallelJob, max_jobs);
+  ll__JobCursor* cursors = LL__ARENA_ALLOC(&ctx->arena, ll__JobCursor, worker_count);
+  uint32_t* ends = LL__ARENA_ALLOC(&ctx->arena, uint32_t, worker_count);
+  if (gen == NULL || sizes == NULL || job_of == NULL || jobs == NULL || cursors == NULL || ends == NULL) {
+    ctx->arena.next_alloc = mark;
+    return NULL;
+  }
+
+  // count the combinators in each subtree, flagging each combinator that has a
+  // parent with LL__EXPANDED. This covers nodes outside the tree, whose stale
+  // handles only count if the jobs go ahead.
+  uint32_t swept = 0;
+  for (uint32_t index = 0; index <= root; index++) {
+    job_of[index] = LL__NIL;
+    sizes[index] = 0;
+    if (nodes->tags[index] < LL__NODE_TYPE_ABOVE) {
+      ll__measure_node(ctx, nodes, layouts, index, base, &swept);
+      continue;
+    }
+    sizes[index] = 1;
+    uint32_t count = ll__child_count(nodes, index);
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t child = ll__child(nodes, index, i, base, &swept);
+      if (nodes->tags[child] < LL__NODE_TYPE_ABOVE) continue;
+      if (sizes[child] & LL__EXPANDED) {
+        ctx->arena.next_alloc = mark;
+        return NULL;
+      }
+      sizes[index] += sizes[child];
+      sizes[child] |= LL__EXPANDED;
+    }
+  }
+
+  // make a job of each subtree of up to `threshold` combinators whose parent
+  // has more, while there's room
+  uint32_t threshold = (sizes[root] & ~LL__EXPANDED) / max_jobs;
+  uint32_t* pending = (uint32_t*)stack;
+  uint32_t top = 0, job_count = 0;
+  uint64_t stack_size = 0;
+  pending[top++] = root;
+  while (top > 0) {
+    uint32_t index = pending[--top];
+    uint32_t size = sizes[index] & ~LL__EXPANDED;
+    if (index != root && size <= threshold && job_count < max_jobs) {
+      job_of[index] = job_count;
+      jobs[job_count++] = (ll__ParallelJob){.root = index};
+      // a path through the subtree has at most `size` combinators and a leaf
+      stack_size += size + 2;
+      continue;
+    }
+    uint32_t count = ll__child_count(nodes, index);
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t child = ll__child(nodes, index, i, base, stale);
+      if (nodes->tags[child] >= LL__NODE_TYPE_ABOVE) pending[top++] = child;
+    }
+  }
+  ll__StackEntry* job_stack = LL__ARENA_ALLOC(&ctx->arena, ll__StackEntry, stack_size);
+  if (job_count < 2 || job_stack == NULL) {
+    ctx->arena.next_alloc = mark;
+    return NULL;
+  }
+  for (uint32_t i = 0; i < job_count; i++) {
+    jobs[i].stack = job_stack;
+    job_stack += (sizes[jobs[i].root] & ~LL__EXPANDED) + 2;
+  }
+
+  *gen = (ll__ParallelGen){
+      .ctx = ctx,
+      .layouts = layouts,
+      .base = base,
+      .jobs = jobs,
+      .job_count = job_count,
+      .job_of = job_of,
+      .cursors = cursors,
+      .ends = ends,
+  };
+  ll__dispatch_jobs(gen);
+  *stale |= swept;
+  for (uint32_t i = 0; i < job_count; i++) *stale |= jobs[i].stale;
+  ll__measure_tree(ctx, nodes, layouts, (uint32_t*)stack, root, base, stale);
+  return gen;
+}
+
+// Lay out `root` and generate its render commands, leaving out subtrees outside
+// `viewport` unless it is NULL
+ll_RenderCommandArray ll__gen_commands(ll_NodeHandle root, const ll_Bounds* viewport) {
+  ll_Context* ctx = ll__current_context;
+  uint32_t base = ctx->generation << LL_HANDLE_INDEX_BITS;
+  uint32_t stale = 0;
+  root = ll__resolve(root, ctx->nodes.length, base, &stale);
+  if (stale) return (ll_RenderCommandArray){0};
+
+  ll__Layout* layouts = LL__ARENA_ALLOC(&ctx->arena, ll__Layout, root + 1);
+  if (layouts == NULL) return (ll_RenderCommandArray){0};
+  ctx->nodes.glyph_x = NULL;
+  if (ll__glyph_measurement_fn != NULL) {
+    ctx->nodes.glyph_x = LL__ARENA_ALLOC(&ctx->arena, const int32_t*, root + 1);
+    if (ctx->nodes.glyph_x == NULL) return (ll_RenderCommandArray){0};
+  }
+  ctx->nodes.text_keys = NULL;
+  if (ctx->text_hashes) {
+    ctx->nodes.text_keys = LL__ARENA_ALLOC(&ctx->arena, uint64_t, root + 1);
+    if (ctx->nodes.text_keys == NULL) return (ll_RenderCommandArray){0};
+  }
+  ll__SubtreeCache* cache = &ctx->subtree_cache;
+  uint32_t* hits = NULL;
+  // spliced commands would point at glyph offsets from an earlier frame
+  if (cache->capacity > 0 && ctx->layout_mode != LL_LAYOUT_MODE_LINEAR_SWEEP && ctx->nodes.glyph_x == NULL) {
+    hits = LL__ARENA_ALLOC(&ctx->arena, uint32_t, root + 1);
+    if (hits == NULL) return (ll_RenderCommandArray){0};
+    for (uint32_t i = 0; i <= root; i++) hits[i] = LL__NIL;
+  }
+  // every recorded combinator also leaves an LL__CACHE_END on the stack
+  ll__StackEntry* stack = LL__ARENA_ALLOC(&ctx->arena, ll__StackEntry, hits != NULL ? 2 * root + 3 : root + 2);
+  if (stack == NULL) return (ll_RenderCommandArray){0};
+  for (uint32_t i = 0; i <= root; i++) layouts[i].done = false;
+
+  // text measured ahead is just what the layout would measure: every leaf up
+  // to `root` for the sweep and the parallel layout, or else the leaves of the
+  // tree outside remembered subtrees, listed after the walk's own stack
+  bool sweep = ctx->layout_mode == LL_LAYOUT_MODE_LINEAR_SWEEP;
+  bool split = !sweep && ctx->parallel.worker_count > 0 && hits == NULL && viewport == NULL &&
+               ctx->nodes.clip_count == 0;
+  uint32_t* leaves = NULL;
+  uint32_t leaf_count = 0;
+  if (ctx->nodes.glyph_x != NULL || ll__text_batch_measurement_fn != NULL) leaves = (uint32_t*)stack + root + 1;
+  if (leaves != NULL && (sweep || split)) {
+    for (uint32_t index = 0; index <= root; index++) {
+      if (ctx->nodes.tags[index] == LL__NODE_TYPE_TEXT) leaves[leaf_count++] = index;
+    }
+  } else if (leaves != NULL || hits != NULL) {
+    leaf_count = ll__prepare_tree(cache, &ctx->nodes, layouts, (uint32_t*)stack, leaves, hits, root, base, &stale);
+  }
+  if (ctx->nodes.glyph_x != NULL) {
+    ll__measure_glyphs(ctx, &ctx->nodes, layouts, leaves, leaf_count);
+  } else if (leaves != NULL && !ll__measure_text_batch(ctx, &ctx->nodes, layouts, leaves, leaf_count)) {
+    return (ll_RenderCommandArray){0};
+  }
+
+  ll__ParallelGen* parallel = NULL;
+  if (sweep) {
+    ll__measure_sweep(ctx, &ctx->nodes, layouts, stack, root, base, &stale);
+  } else {
+    if (split) parallel = ll__measure_parallel(ctx, layouts, stack, root, base, &stale);
+    if (parallel == NULL) ll__measure_tree(ctx, &ctx->nodes, layouts, (uint32_t*)stack, root, base, &stale);
+  }
+  // the sweep and the parallel layout measure every node up to `root`, so a
+  // stale handle they ran into may lie outside the tree, where it's harmless
+  if (stale && (sweep || parallel != NULL)) {
+    stale = ll__tree_stale(&ctx->nodes, layouts, root, base);
+  }
+  if (stale) return (ll_RenderCommandArray){0};
+
+  ll_RenderCommandArray cmds = {.capacity = layouts[root].command_count};
+  cmds.internalArray = LL__ARENA_ALLOC(&ctx->arena, ll_RenderCommand, cmds.capacity);
+  if (cmds.internalArray == NULL) return (ll_RenderCommandArray){0};
+
+  ll_Vec2 origin = {-layouts[root].pinhole.x, -layouts[root].pinhole.y};
+  // the sweep fills in every command slot, so it can't cull
+  if (ctx->layout_mode != LL_LAYOUT_MODE_LINEAR_SWEEP || viewport != NULL || ctx->nodes.clip_count > 0 ||
+      !ll__emit_sweep(&ctx->nodes, layouts, stack, &cmds, root, origin)) {
+    cmds.length = 0;
+    if (hits != NULL) cache->frames[cache->current ^ 1].entry_count = 0;
+    ll__emit_tree(&ctx->nodes, layouts, stack, cache, hits, parallel, viewport, &cmds,
+                  (ll__StackEntry){root, origin, 0});
+    if (parallel != NULL) {
+      parallel->cmds = &cmds;
+      ll__dispatch_jobs(parallel);
+    }
+  }
+  if (hits != NULL) ll__subtree_cache_commit(cache, &cmds);
+  return cmds;
+}
+
+// damage tracking -------------------------------------------------------------
+
+// The most dirty rectangles ll_track_damage reports; beyond this, new
+// rectangles are merged into whichever existing one grows the least
+#define LL__MAX_DAMAGE_RECTS 32
+
+bool ll__same_command(const ll_RenderCommand* a, const ll_RenderCommand* b) {
+  if (a->tag != b->tag || a->bounds.posn.x != b->bounds.posn.x || a->bounds.posn.y != b->bounds.posn.y ||
+      a->bounds.size.width != b->bounds.size.width || a->bounds.size.height != b->bounds.size.height) {
+    return false;
+  }
+  switch (a->tag) {
+  case LL_RENDER_DATA_TAG_IMAGE:
+    return a->render_data.image_render_data.imageData == b->render_data.image_render_data.imageData;
+  case LL_RENDER_DATA_TAG_TEXT:
+    return a->render_data.text_render_data.text_hash == b->render_data.text_render_data.text_hash &&
+           a->render_data.text_render_data.letter_spacing == b->render_data.text_render_data.letter_spacing;
+  default:
+    return true;
+  }
+}
+
+uint64_t ll__command_key(const ll_RenderCommand* cmd) {
+  uint64_t hash = ll__mix64((uint64_t)(uint32_t)cmd->bounds.posn.x << 32 | (uint32_t)cmd->bounds.posn.y);
+  hash = ll__mix64(hash ^ ((uint64_t)cmd->bounds.size.width << 32 | cmd->bounds.size.height) ^ cmd->tag);
+  uint64_t data = 0;
+  if (cmd->tag == LL_RENDER_DATA_TAG_IMAGE) data = (uint64_t)(uintptr_t)cmd->render_data.image_render_data.imageData;
+  if (cmd->tag == LL_RENDER_DATA_TAG_TEXT) data = cmd->render_data.text_render_data.text_hash;
+  return ll__mix64(hash ^ data);
+}
+
+uint64_t ll__area(ll_Size size) {
+  return (uint64_t)size.width * size.height;
+}
+
+// Return the smallest bounds enclosing both `a` and `b`
+ll_Bounds ll__union(ll_Bounds a, ll_Bounds b) {
+  int32_t min_x = a.posn.x < b.posn.x ? a.posn.x : b.posn.x;
+  int32_t min_y = a.posn.y < b.posn.y ? a.posn.y : b.posn.y;
+  int64_t max_x = (int64_t)a.posn.x + a.size.width;
+  int64_t max_y = (int64_t)a.posn.y + a.size.height;
+  if (max_x < (int64_t)b.posn.x + b.size.width) max_x = (int64_t)b.posn.x + b.size.width;
+  if (max_y < (int64_t)b.posn.y + b.size.height) max_y = (int64_t)b.posn.y + b.size.height;
+  return (ll_Bounds){{min_x, min_y}, {(uint32_t)(max_x - min_x), (uint32_t)(max_y - min_y)}};
+}
+
+// Add `rect` to the `*count` dirty rectangles at `rects`, merging it with every
+// rectangle it overlaps or that it can share a box with for no more area than
+// the two take up apart
+void ll__add_damage(ll_Bounds* rects, uint32_t* count, ll_Bounds rect) {
+  if (rect.size.width == 0 || rect.size.height == 0) return;
+  for (uint32_t i = 0; i < *count;) {
+    ll_Bounds merged = ll__union(rects[i], rect);
+    if (ll__intersects(rects[i], rect) || ll__area(merged.size) <= ll__area(rects[i].size) + ll__area(rect.size)) {
+      rect = merged;
+      rects[i] = rects[--*count];
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+  if (*count < LL__MAX_DAMAGE_RECTS) {
+    rects[(*count)++] = rect;
+    return;
+  }
+
+  uint32_t best = 0;
+  uint64_t best_growth = UINT64_MAX;
+  for (uint32_t i = 0; i < *count; i++) {
+    uint64_t growth = ll__area(ll__union(rects[i], rect).size) - ll__area(rects[i].size);
+    if (growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+  rect = ll__union(rects[best], rect);
+  rects[best] = rects[--*count];
+  ll__add_damage(rects, count, rect);
+}
+
+// Add the bounds of every command of `next` that doesn't appear in `prev` in
+// the same order to the dirty rectangles, and vice versa. Commands are matched
+// greedily: each command of `next` is matched to the first identical command
+// of `prev` after the last one matched. Returns false if the arena is
+// exhausted.
+bool ll__diff_commands(ll__Arena* arena, const ll_RenderCommand* prev, uint32_t prev_length,
+                       const ll_RenderCommand* next, uint32_t next_length, ll_Bounds* rects, uint32_t* count) {
+  uint32_t bucket_count = 1;
+  while (bucket_count < prev_length) bucket_count <<= 1;
+  uint32_t* buckets = LL__ARENA_ALLOC(arena, uint32_t, bucket_count);
+  uint32_t* chain = LL__ARENA_ALLOC(arena, uint32_t, prev_length);
+  bool* matched = LL__ARENA_ALLOC(arena, bool, prev_length);
+  if (buckets == NULL || chain == NULL || matched == NULL) return false;
+
+  // chain each bucket in increasing order
+  for (uint32_t i = 0; i < bucket_count; i++) buckets[i] = LL__NIL;
+  for (uint32_t i = prev_length; i-- > 0;) {
+    uint32_t* bucket = &buckets[ll__command_key(&prev[i]) & (bucket_count - 1)];
+    chain[i] = *bucket;
+    *bucket = i;
+    matched[i] = false;
+  }
+
+  uint32_t last = 0;
+  for (uint32_t i = 0; i < next_length; i++) {
+    uint32_t j = buckets[ll__command_key(&next[i]) & (bucket_count - 1)];
+    while (j != LL__NIL && (j < last || matched[j] || !ll__same_command(&prev[j], &next[i]))) j = chain[j];
+    if (j == LL__NIL) {
+      ll__add_damage(rects, count, next[i].bounds);
+    } else {
+      matched[j] = true;
+      last = j;
+    }
+  }
+  for (uint32_t i = 0; i < prev_length; i++) {
+    if (!matched[i]) ll__add_damage(rects, count, prev[i].bounds);
+  }
+  return true;
+}
+
+// command diffing -------------------------------------------------------------
+
+typedef struct {
+  uint64_t identity;
+  // the number of commands with this identity seen so far, or zero for an
+  // empty slot
+  uint32_t count;
+} ll__IdentityCount;
+
+// Return the table size ll__command_ids and ll__diff_index use for `length`
+// commands
+uint32_t ll__diff_table_size(uint32_t length) {
+  uint32_t table_size = 1;
+  while (table_size < 2 * (uint64_t)length) table_size <<= 1;
+  return table_size;
+}
+
+// Write the id of each command of `cmds` to `ids`: a hash of its kind, its key
+// or else its image or text contents, and how many earlier commands share
+// both. Only the stored text hashes are read, since the strings of `prev` may
+// be gone. Returns false if the arena is exhausted.
+bool ll__command_ids(ll__Arena* arena, ll_RenderCommandArray cmds, uint64_t* ids) {
+  uint32_t mask = ll__diff_table_size(cmds.length) - 1;
+  ll__IdentityCount* counts = LL__ARENA_ALLOC(arena, ll__IdentityCount, mask + 1);
+  if (counts == NULL) return false;
+  for (uint32_t i = 0; i <= mask; i++) counts[i].count = 0;
+
+  for (uint32_t i = 0; i < cmds.length; i++) {
+    const ll_RenderCommand* cmd = &cmds.internalArray[i];
+    uint64_t identity = 0;
+    if (cmd->key != 0) {
+      identity = ll__mix64(cmd->key);
+    } else if (cmd->tag == LL_RENDER_DATA_TAG_IMAGE) {
+      identity = ll__image_key(cmd->render_data.image_render_data.imageData);
+    } else if (cmd->tag == LL_RENDER_DATA_TAG_TEXT) {
+      identity = cmd->render_data.text_render_data.text_hash;
+    }
+    identity = ll__mix64(identity ^ cmd->tag);
+
+    uint32_t slot = (uint32_t)identity & mask;
+    while (counts[slot].count != 0 && counts[slot].identity != identity) slot = (slot + 1) & mask;
+    counts[slot].identity = identity;
+    ids[i] = ll__mix64(identity + counts[slot].count++ * UINT64_C(0x9e3779b97f4a7c15));
+  }
+  return true;
+}
+
+// tile binning ----------------------------------------------------------------
+
+// A rectangle of pixels, from (x0, y0) up to but not including (x1, y1)
+typedef struct {
+  int64_t x0, y0, x1, y1;
+} ll__Rect;
+
+// A rectangle of tiles, from (x0, y0) up to but not including (x1, y1)
+typedef struct {
+  uint32_t x0, y0, x1, y1;
+} ll__TileRange;
+
+// Return the tiles of `bins` that `bounds`, clipped to `*clip`, overlaps, and
+// write the clipped bounds to `*clip`
+ll__TileRange ll__tile_range(const ll_TileBins* bins, ll_Bounds bounds, ll__Rect* clip) {
+  ll__Rect r = {bounds.posn.x, bounds.posn.y, (int64_t)bounds.posn.x + bounds.size.width,
+                (int64_t)bounds.posn.y + bounds.size.height};
+  if (r.x0 < clip->x0) r.x0 = clip->x0;
+  if (r.y0 < clip->y0) r.y0 = clip->y0;
+  if (r.x1 > clip->x1) r.x1 = clip->x1;
+  if (r.y1 > clip->y1) r.y1 = clip->y1;
+  if (r.x1 < r.x0) r.x1 = r.x0;
+  if (r.y1 < r.y0) r.y1 = r.y0;
+  *clip = r;
+  if (r.x0 == r.x1 || r.y0 == r.y1) return (ll__TileRange){0};
+  return (ll__TileRange){
+      (uint32_t)(r.x0 / bins->tile_size),
+      (uint32_t)(r.y0 / bins->tile_size),
+      (uint32_t)((r.x1 - 1) / bins->tile_size + 1),
+      (uint32_t)((r.y1 - 1) / bins->tile_size + 1),
+  };
+}
 
 // public functions ============================================================
 
+void ll_set_text_measurement_fn(ll_Size (*text_measurement_fn)(const char* text, uint16_t letter_spacing)) {
+  ll__text_measurement_fn = text_measurement_fn;
+}
+
+void ll_set_text_batch_measurement_fn(void (*text_batch_measurement_fn)(
+    const char* const* texts, const uint16_t* letter_spacings, ll_Size* sizes, uint32_t count)) {
+  ll__text_batch_measurement_fn = text_batch_measurement_fn;
+}
+
+void ll_set_glyph_measurement_fn(ll_Size (*glyph_measurement_fn)(const char* text, uint16_t letter_spacing,
+                                                                 int32_t* glyph_x)) {
+  ll__glyph_measurement_fn = glyph_measurement_fn;
+}
+
+void ll_set_image_measurement_fn(ll_Size (*image_measurement_fn)(LL_IMAGE_TYPE* image)) {
+  ll__image_measurement_fn = image_measurement_fn;
+}
+
+void ll_configure_max_nodes(uint32_t max_nodes) {
+  ll__max_nodes = max_nodes;
+}
+
+uint64_t ll_min_arena_size(void) {
+  uint64_t batch = 0;
+  if (ll__glyph_measurement_fn != NULL) {
+    batch = LL__ARENA_FOOTPRINT(const int32_t*, ll__max_nodes + 1);
+  } else if (ll__text_batch_measurement_fn != NULL) {
+    batch = LL__ARENA_FOOTPRINT(const char*, ll__max_nodes) + LL__ARENA_FOOTPRINT(uint16_t, ll__max_nodes)
+          + LL__ARENA_FOOTPRINT(ll_Size, ll__max_nodes) + LL__ARENA_FOOTPRINT(uint32_t, ll__max_nodes);
+  }
+  return batch
+       + LL__ARENA_FOOTPRINT(ll_Context, 1)
+       + LL__ARENA_FOOTPRINT(uint8_t, ll__max_nodes + 1)
+       + LL__ARENA_FOOTPRINT(uint32_t, ll__max_nodes + 1)
+       + LL__MAX_PAYLOAD_SIZE * (uint64_t)ll__max_nodes + _Alignof(max_align_t) - 1
+       + LL__ARENA_FOOTPRINT(ll__Layout, ll__max_nodes + 1)
+       + LL__ARENA_FOOTPRINT(ll__StackEntry, ll__max_nodes + 2)
+       + LL__ARENA_FOOTPRINT(ll_RenderCommand, ll__max_nodes);
+}
+
 ll_Context* ll_init(char* arena_mem, size_t arena_capacity) {
   ll__Arena arena = (ll__Arena){
       .capacity = arena_capacity,
       .mem = arena_mem,
   };
 
-  return (ll_Context) { .arena = arena, };
+  // the first node of every generation is the empty leaf
+  if (ll__max_nodes > LL__HANDLE_INDEX_MASK - 1) return NULL;
+  uint64_t payload_capacity = LL__MAX_PAYLOAD_SIZE * (uint64_t)ll__max_nodes;
+  if (payload_capacity > UINT32_MAX) return NULL;
+  ll_Context* ctx = LL__ARENA_ALLOC(&arena, ll_Context, 1);
+  uint8_t* tags = LL__ARENA_ALLOC(&arena, uint8_t, ll__max_nodes + 1);
+  uint32_t* payload_offsets = LL__ARENA_ALLOC(&arena, uint32_t, ll__max_nodes + 1);
+  char* payloads = LL__ALLOC_PAYLOADS(&arena, payload_capacity);
+  if (ctx == NULL || tags == NULL || payload_offsets == NULL || payloads == NULL) return NULL;
+
+  arena.frame_start = arena.next_alloc;
+  *ctx = (ll_Context){
+      .max_nodes = ll__max_nodes,
+      .arena = arena,
+      .nodes = {
+          .capacity = ll__max_nodes + 1,
+          .tags = tags,
+          .payload_offsets = payload_offsets,
+          .payloads = payloads,
+          .payload_capacity = (uint32_t)payload_capacity,
+      },
+  };
+  return ctx;
+}
+
+void ll_set_layout_mode(ll_Context* ctx, ll_LayoutMode mode) {
+  ctx->layout_mode = mode;
+}
+
+void ll_set_parallel_layout(ll_Context* ctx, ll_ParallelConfig conf) {
+  ctx->parallel = conf;
+}
+
+uint64_t ll_parallel_layout_arena_size(uint32_t worker_count) {
+  uint64_t max_jobs = LL__JOBS_PER_WORKER * (uint64_t)worker_count;
+  return LL__ARENA_FOOTPRINT(ll__ParallelGen, 1)
+       + 2 * LL__ARENA_FOOTPRINT(uint32_t, ll__max_nodes + 1)
+       + LL__ARENA_FOOTPRINT(ll__ParallelJob, max_jobs)
+       + LL__ARENA_FOOTPRINT(ll__JobCursor, worker_count)
+       + LL__ARENA_FOOTPRINT(uint32_t, worker_count)
+       + LL__ARENA_FOOTPRINT(ll__StackEntry, ll__max_nodes + 1 + 2 * max_jobs);
+}
+
+uint64_t ll_cache_arena_size(uint32_t capacity) {
+  uint64_t bucket_count = 1;
+  while (bucket_count < capacity) bucket_count <<= 1;
+  return LL__ARENA_FOOTPRINT(ll__SizeCacheEntry, capacity) + LL__ARENA_FOOTPRINT(uint32_t, bucket_count);
+}
+
+bool ll_enable_text_cache(ll_Context* ctx, uint32_t capacity) {
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  if (capacity == 0 || !ll__size_cache_init(&ctx->text_cache, &ctx->arena, capacity)) return false;
+  ctx->arena.frame_start = ctx->arena.next_alloc;
+  return true;
+}
+
+ll_CacheStats ll_text_cache_stats(const ll_Context* ctx) {
+  return ctx->text_cache.stats;
+}
+
+bool ll_enable_image_cache(ll_Context* ctx, uint32_t capacity) {
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  if (capacity == 0 || !ll__size_cache_init(&ctx->image_cache, &ctx->arena, capacity)) return false;
+  ctx->arena.frame_start = ctx->arena.next_alloc;
+  return true;
+}
+
+void ll_invalidate_image(ll_Context* ctx, LL_IMAGE_TYPE* image) {
+  if (ctx->image_cache.capacity > 0) ll__size_cache_remove(&ctx->image_cache, ll__image_key(image));
+  ll_invalidate_subtrees(ctx);
+}
+
+ll_CacheStats ll_image_cache_stats(const ll_Context* ctx) {
+  return ctx->image_cache.stats;
+}
+
+uint64_t ll_subtree_cache_arena_size(uint32_t capacity) {
+  uint64_t table_size = 1;
+  while (table_size < 2 * (uint64_t)capacity) table_size <<= 1;
+  return LL__ARENA_FOOTPRINT(uint64_t, ll__max_nodes + 1)
+       + LL__ARENA_FOOTPRINT(uint32_t, table_size)
+       + 2 * LL__ARENA_FOOTPRINT(ll__SubtreeEntry, capacity)
+       + 2 * LL__ARENA_FOOTPRINT(ll_RenderCommand, capacity)
+       + LL__ARENA_FOOTPRINT(uint32_t, ll__max_nodes + 1)
+       + LL__ARENA_FOOTPRINT(ll__StackEntry, ll__max_nodes + 1);
+}
+
+bool ll_enable_subtree_cache(ll_Context* ctx, uint32_t capacity) {
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  if (capacity == 0 || !ll__subtree_cache_init(&ctx->subtree_cache, &ctx->arena, ctx->max_nodes, capacity)) {
+    ctx->subtree_cache = (ll__SubtreeCache){0};
+    return false;
+  }
+  ctx->arena.frame_start = ctx->arena.next_alloc;
+  return true;
+}
+
+void ll_invalidate_subtrees(ll_Context* ctx) {
+  if (ctx->subtree_cache.capacity > 0) ll__subtree_cache_clear(&ctx->subtree_cache);
+}
+
+ll_CacheStats ll_subtree_cache_stats(const ll_Context* ctx) {
+  return ctx->subtree_cache.stats;
+}
+
+uint64_t ll_hash_consing_arena_size(void) {
+  uint64_t table_size = 1;
+  while (table_size < 2 * ((uint64_t)ll__max_nodes + 1)) table_size <<= 1;
+  return LL__ARENA_FOOTPRINT(ll_NodeHandle, table_size);
+}
+
+bool ll_enable_hash_consing(ll_Context* ctx) {
+  uint32_t table_size = 1;
+  while (table_size < 2 * ((uint64_t)ctx->max_nodes + 1)) table_size <<= 1;
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  ll_NodeHandle* handles = LL__ARENA_ALLOC(&ctx->arena, ll_NodeHandle, table_size);
+  if (handles == NULL) return false;
+  for (uint32_t i = 0; i < table_size; i++) handles[i] = LL__INVALID_HANDLE;
+  ctx->interned = (ll__InternTable){.handles = handles, .mask = table_size - 1};
+  ctx->arena.frame_start = ctx->arena.next_alloc;
+  return true;
+}
+
+uint64_t ll_text_hashes_arena_size(void) {
+  return LL__ARENA_FOOTPRINT(uint64_t, ll__max_nodes + 1);
+}
+
+void ll_enable_text_hashes(ll_Context* ctx) {
+  ctx->text_hashes = true;
+}
+
+uint64_t ll_damage_tracking_arena_size(uint32_t capacity) {
+  uint64_t bucket_count = 1;
+  while (bucket_count < capacity) bucket_count <<= 1;
+  return ll_text_hashes_arena_size()
+       + LL__ARENA_FOOTPRINT(ll_RenderCommand, capacity)
+       + LL__ARENA_FOOTPRINT(ll_Bounds, LL__MAX_DAMAGE_RECTS)
+       + LL__ARENA_FOOTPRINT(uint32_t, bucket_count)
+       + LL__ARENA_FOOTPRINT(uint32_t, capacity)
+       + LL__ARENA_FOOTPRINT(bool, capacity)
+       + LL__ARENA_FOOTPRINT(ll_RenderCommand, capacity);
+}
+
+bool ll_enable_damage_tracking(ll_Context* ctx, uint32_t capacity) {
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  ll_RenderCommand* commands = LL__ARENA_ALLOC(&ctx->arena, ll_RenderCommand, capacity);
+  if (capacity == 0 || commands == NULL) return false;
+  ctx->damage = (ll__DamageTracker){.commands = commands, .capacity = capacity};
+  ctx->text_hashes = true;
+  ctx->arena.frame_start = ctx->arena.next_alloc;
+  return true;
+}
+
+void ll_invalidate_damage(ll_Context* ctx) {
+  ctx->damage.valid = false;
+}
+
+// Fold the memory the current frame of `ctx` has used so far into `stats`
+void ll__note_high_water(const ll_Context* ctx, ll_MemoryStats* stats) {
+  uint64_t frame_bytes = ctx->arena.next_alloc - ctx->arena.frame_start + ctx->arena.block_bytes;
+  if (stats->nodes < ctx->nodes.length) stats->nodes = ctx->nodes.length;
+  if (stats->payload_bytes < ctx->nodes.payload_length) stats->payload_bytes = ctx->nodes.payload_length;
+  if (stats->frame_bytes < frame_bytes) stats->frame_bytes = frame_bytes;
+}
+
+void ll_begin(ll_Context* ctx) {
+  ll__note_high_water(ctx, &ctx->high_water);
+  if (ctx->grown || ctx->arena.blocks != NULL) ctx->high_water.grown_frames++;
+  ll_release_blocks(ctx);
+  ctx->arena.allocator = ctx->allocator;
+  ctx->subcontexts = 0;
+  ctx->generation = (ctx->generation + 1) & LL__GENERATION_MASK;
+  if (ctx->generation == 0) ctx->generation = 1;
+  ctx->arena.next_alloc = ctx->arena.frame_start;
+  ctx->nodes.tags[0] = LL__NODE_TYPE_EMPTY;
+  ctx->nodes.payload_offsets[0] = 0;
+  ctx->nodes.length = 1;
+  ctx->nodes.payload_length = 0;
+  ctx->nodes.clip_count = 0;
+  if (ctx->subtree_cache.hashes != NULL) ctx->subtree_cache.hashes[0] = 1;
+  ll__current_context = ctx;
+}
+
+void ll_set_current_context(ll_Context* ctx) {
+  ll__current_context = ctx;
+}
+
+void ll_enable_growth(ll_Context* ctx, ll_Allocator allocator) {
+  ctx->allocator = allocator;
+}
+
+void ll_release_blocks(ll_Context* ctx) {
+  if (ctx->grown) {
+    ctx->nodes = ctx->home_nodes;
+    ctx->subtree_cache.hashes = ctx->home_hashes;
+    ctx->interned = ctx->home_interned;
+    ctx->grown = false;
+  }
+  ll__arena_free_blocks(&ctx->arena);
+}
+
+ll_MemoryStats ll_memory_stats(const ll_Context* ctx) {
+  ll_MemoryStats stats = ctx->high_water;
+  ll__note_high_water(ctx, &stats);
+  return stats;
+}
+
+ll_Context* ll_begin_subcontext(ll_Context* ctx, uint32_t max_nodes) {
+  ll__NodeArray* nodes = &ctx->nodes;
+  uint64_t payload_size = LL__MAX_PAYLOAD_SIZE * (uint64_t)max_nodes;
+  if ((max_nodes > nodes->capacity - nodes->length || payload_size > nodes->payload_capacity - nodes->payload_length) &&
+      !ll__grow_nodes(ctx, (uint64_t)nodes->length + max_nodes, nodes->payload_length + payload_size)) {
+    return NULL;
+  }
+  ll_Context* sub = LL__ARENA_ALLOC(&ctx->arena, ll_Context, 1);
+  if (sub == NULL) return NULL;
+
+  // the subcontext shares the node array, but gets a range of it to itself,
+  // and an empty arena
+  *sub = (ll_Context){
+      .max_nodes = max_nodes,
+      .generation = ctx->generation,
+      .nodes = *nodes,
+      .subtree_cache = {.hashes = ctx->subtree_cache.hashes},
+  };
+  sub->nodes.capacity = nodes->length + max_nodes;
+  sub->nodes.payload_capacity = nodes->payload_length + (uint32_t)payload_size;
+  sub->nodes.clip_count = 0;
+  // slots left unused are empty leaves, so that sweeps over the node array
+  // can pass over them
+  memset(nodes->tags + nodes->length, LL__NODE_TYPE_EMPTY, max_nodes);
+  nodes->length += max_nodes;
+  nodes->payload_length += (uint32_t)payload_size;
+  ctx->subcontexts++;
+  return sub;
+}
+
+ll_NodeHandle ll_graft(ll_Context* ctx, ll_Context* sub, ll_NodeHandle root) {
+  ctx->nodes.clip_count += sub->nodes.clip_count;
+  sub->nodes.capacity = sub->nodes.length;
+  if (ctx->subcontexts > 0) ctx->subcontexts--;
+  return root;
+}
+
+ll_NodeHandle ll_empty(void) {
+  return ll__current_context->generation << LL_HANDLE_INDEX_BITS;
+}
+
+ll_NodeHandle ll_image(LL_IMAGE_TYPE* image_data, ll_Size image_size) {
+  ll_NodeHandle handle;
+  ll__ImagePayload* image = LL__ALLOC_NODE(LL__NODE_TYPE_IMAGE, ll__ImagePayload, &handle);
+  if (image == NULL) return LL__INVALID_HANDLE;
+  *image = (ll__ImagePayload){.image_data = image_data, .image_size = image_size};
+  return ll__finish_node(handle, NULL, 0);
+}
+
+ll_NodeHandle ll_text(ll_TextConfig conf, const char* text) {
+  ll_NodeHandle handle;
+  ll__TextPayload* payload = LL__ALLOC_NODE(LL__NODE_TYPE_TEXT, ll__TextPayload, &handle);
+  if (payload == NULL) return LL__INVALID_HANDLE;
+  *payload = (ll__TextPayload){.text = text, .config = conf};
+  return ll__finish_node(handle, NULL, 0);
+}
+
+// Allocate a binary node followed by `conf_size` bytes of configuration. Its
+// children are validated by ll_gen_commands.
+ll_NodeHandle ll__binary(enum ll__Tag tag, const void* conf, uint32_t conf_size,
+                         ll_NodeHandle first, ll_NodeHandle second) {
+  ll_NodeHandle handle;
+  ll__BinaryPayload* payload = ll__alloc_node(tag, sizeof(ll__BinaryPayload) + conf_size,
+                                              _Alignof(ll__BinaryPayload), &handle);
+  if (payload == NULL) return LL__INVALID_HANDLE;
+  *payload = (ll__BinaryPayload){.first_child = first, .second_child = second};
+  memcpy(payload + 1, conf, conf_size);
+  return ll__finish_node(handle, conf, conf_size);
+}
+
+ll_NodeHandle ll_above(ll_AboveConfig conf, ll_NodeHandle above, ll_NodeHandle below) {
+  return ll__binary(LL__NODE_TYPE_ABOVE, &conf, sizeof(conf), above, below);
+}
+
+ll_NodeHandle ll_beside(ll_BesideConfig conf, ll_NodeHandle left, ll_NodeHandle right) {
+  return ll__binary(LL__NODE_TYPE_BESIDE, &conf, sizeof(conf), left, right);
+}
+
+ll_NodeHandle ll_overlay(ll_OverlayConfig conf, ll_NodeHandle over, ll_NodeHandle under) {
+  return ll__binary(LL__NODE_TYPE_OVERLAY, &conf, sizeof(conf), over, under);
+}
+
+// Allocate a span node followed by `conf_size` bytes of configuration and the
+// `count` handles at `nodes`. Its children are validated by ll_gen_commands.
+ll_NodeHandle ll__span(enum ll__Tag tag, const void* conf, uint32_t conf_size, const ll_NodeHandle* nodes,
+                       uint32_t count) {
+  if (count == 0) return ll_empty();
+  if (count == 1) return nodes[0];
+  ll_NodeHandle handle;
+  uint64_t size = sizeof(ll__SpanPayload) + conf_size + (sizeof(ll_NodeHandle) + sizeof(ll_Vec2)) * (uint64_t)count;
+  if (size > UINT32_MAX) return LL__INVALID_HANDLE;
+  ll__SpanPayload* payload = ll__alloc_node(tag, (uint32_t)size, _Alignof(ll__SpanPayload), &handle);
+  if (payload == NULL) return LL__INVALID_HANDLE;
+  *payload = (ll__SpanPayload){.child_count = count};
+  memcpy(payload + 1, conf, conf_size);
+  char* children = (char*)(payload + 1) + conf_size;
+  memcpy(children, nodes, sizeof(ll_NodeHandle) * count);
+  memset(children + sizeof(ll_NodeHandle) * count, 0, sizeof(ll_Vec2) * count);
+  return ll__finish_node(handle, conf, conf_size);
+}
+
+ll_NodeHandle ll_above_n(ll_AboveConfig conf, const ll_NodeHandle* nodes, uint32_t count) {
+  return ll__span(LL__NODE_TYPE_ABOVE_N, &conf, sizeof(conf), nodes, count);
+}
+
+ll_NodeHandle ll_beside_n(ll_BesideConfig conf, const ll_NodeHandle* nodes, uint32_t count) {
+  return ll__span(LL__NODE_TYPE_BESIDE_N, &conf, sizeof(conf), nodes, count);
+}
+
+// Fold `count` nodes with the binary node `tag` (see LL_FOLDL1 and
+// LL_FOLD_TREE)
+ll_NodeHandle ll__fold(enum ll__Tag tag, const void* conf, uint32_t conf_size, const ll_NodeHandle* nodes,
+                       uint32_t count, bool balanced) {
+  if (count == 0) return ll_empty();
+  if (balanced) {
+    if (count == 1) return nodes[0];
+    ll_NodeHandle first = ll__fold(tag, conf, conf_size, nodes, count / 2, true);
+    ll_NodeHandle second = ll__fold(tag, conf, conf_size, nodes + count / 2, count - count / 2, true);
+    return ll__binary(tag, conf, conf_size, first, second);
+  }
+  ll_NodeHandle folded = nodes[0];
+  for (uint32_t i = 1; i < count; i++) folded = ll__binary(tag, conf, conf_size, folded, nodes[i]);
+  return folded;
+}
+
+// Allocate a unary node followed by `conf_size` bytes of configuration. Its
+// child is validated by ll_gen_commands.
+ll_NodeHandle ll__unary(enum ll__Tag tag, const void* conf, uint32_t conf_size, ll_NodeHandle child) {
+  ll_NodeHandle handle;
+  ll__UnaryPayload* payload = ll__alloc_node(tag, sizeof(ll__UnaryPayload) + conf_size,
+                                             _Alignof(ll__UnaryPayload), &handle);
+  if (payload == NULL) return LL__INVALID_HANDLE;
+  *payload = (ll__UnaryPayload){.child = child};
+  if (conf_size > 0) memcpy(payload + 1, conf, conf_size);
+  return ll__finish_node(handle, conf, conf_size);
+}
+
+ll_NodeHandle ll_move_pinhole(ll_MovePinholeConfig conf, ll_NodeHandle node) {
+  return ll__unary(LL__NODE_TYPE_MOVE_PINHOLE, &conf, sizeof(conf), node);
+}
+
+ll_NodeHandle ll_reset_pinhole(ll_NodeHandle node) {
+  return ll__unary(LL__NODE_TYPE_RESET_PINHOLE, NULL, 0, node);
+}
+
+ll_NodeHandle ll_key(uint64_t key, ll_NodeHandle node) {
+  return ll__unary(LL__NODE_TYPE_KEY, &key, sizeof(key), node);
+}
+
+ll_NodeHandle ll_clip(ll_ClipConfig conf, ll_NodeHandle node) {
+  return ll__unary(LL__NODE_TYPE_CLIP, &conf, sizeof(conf), node);
+}
+
+ll_NodeHandle ll_virtual_list(ll_VirtualListConfig conf, ll_NodeHandle (*build_row)(uint32_t row, void* user_data),
+                              void* user_data) {
+  // overlay each visible row onto the empty leaf, which stays at the top-left
+  // corner, with its pinhole moved up to that corner
+  ll_NodeHandle rows = ll_empty();
+  uint32_t first = conf.row_height > 0 ? conf.scroll / conf.row_height : 0;
+  uint64_t end = conf.row_height > 0 ? ((uint64_t)conf.scroll + conf.size.height + conf.row_height - 1) / conf.row_height : 0;
+  if (end > conf.row_count) end = conf.row_count;
+  for (uint32_t row = first; row < end; row++) {
+    ll_MovePinholeConfig slot = {.offset = {0, -(int32_t)((row - first) * conf.row_height)}};
+    rows = ll_overlay((ll_OverlayConfig){0}, ll_move_pinhole(slot, ll_reset_pinhole(build_row(row, user_data))), rows);
+  }
+
+  ll_ClipConfig clip = {
+      .size = conf.size,
+      .offset = {0, (int32_t)((uint64_t)first * conf.row_height - conf.scroll)},
+  };
+  return ll_clip(clip, rows);
+}
+
+ll_RenderCommandArray ll_gen_commands(ll_NodeHandle root) {
+  return ll__gen_commands(root, NULL);
+}
+
+ll_RenderCommandArray ll_gen_commands_clipped(ll_NodeHandle root, ll_Bounds viewport) {
+  return ll__gen_commands(root, &viewport);
+}
+
+ll_Damage ll_track_damage(ll_Context* ctx, ll_RenderCommandArray cmds) {
+  ll__DamageTracker* damage = &ctx->damage;
+  if (damage->capacity == 0) return (ll_Damage){0};
+  ll_Damage result = {
+      .rects = LL__ARENA_ALLOC(&ctx->arena, ll_Bounds, LL__MAX_DAMAGE_RECTS),
+      .commands.internalArray = LL__ARENA_ALLOC(&ctx->arena, ll_RenderCommand, cmds.length),
+      .commands.capacity = cmds.length,
+  };
+  if (result.rects == NULL || result.commands.internalArray == NULL) return (ll_Damage){0};
+
+  if (damage->valid && cmds.length <= damage->capacity) {
+    if (!ll__diff_commands(&ctx->arena, damage->commands, damage->length, cmds.internalArray, cmds.length,
+                           result.rects, &result.rect_count)) {
+      return (ll_Damage){0};
+    }
+  } else {
+    ll__add_damage(result.rects, &result.rect_count, damage->overflow);
+    for (uint32_t i = 0; i < damage->length; i++) {
+      ll__add_damage(result.rects, &result.rect_count, damage->commands[i].bounds);
+    }
+    for (uint32_t i = 0; i < cmds.length; i++) {
+      ll__add_damage(result.rects, &result.rect_count, cmds.internalArray[i].bounds);
+    }
+  }
+
+  // scissors are kept regardless, so that kept commands stay inside them
+  for (uint32_t i = 0; i < cmds.length; i++) {
+    bool scissor = cmds.internalArray[i].tag >= LL_RENDER_DATA_TAG_SCISSOR_START;
+    for (uint32_t j = 0; j < result.rect_count; j++) {
+      if (scissor || ll__intersects(cmds.internalArray[i].bounds, result.rects[j])) {
+        result.commands.internalArray[result.commands.length++] = cmds.internalArray[i];
+        break;
+      }
+    }
+  }
+
+  damage->valid = cmds.length <= damage->capacity;
+  damage->overflow = (ll_Bounds){0};
+  if (damage->valid) {
+    damage->length = cmds.length;
+    memcpy(damage->commands, cmds.internalArray, sizeof(ll_RenderCommand) * cmds.length);
+  } else {
+    damage->length = 0;
+    for (uint32_t i = 0; i < cmds.length; i++) {
+      damage->overflow = i == 0 ? cmds.internalArray[i].bounds : ll__union(damage->overflow, cmds.internalArray[i].bounds);
+    }
+  }
+  return result;
+}
+
+
+uint64_t ll_diff_commands_arena_size(uint32_t max_commands) {
+  uint32_t table_size = ll__diff_table_size(max_commands);
+  return 2 * LL__ARENA_FOOTPRINT(uint64_t, max_commands)
+       + 2 * LL__ARENA_FOOTPRINT(ll__IdentityCount, table_size)
+       + LL__ARENA_FOOTPRINT(uint32_t, table_size)
+       + 3 * LL__ARENA_FOOTPRINT(uint32_t, max_commands)
+       + 2 * LL__ARENA_FOOTPRINT(bool, max_commands)
+       + LL__ARENA_FOOTPRINT(ll_DiffOp, 3 * (uint64_t)max_commands);
+}
+
+ll_DiffOpArray ll_diff_commands(ll_Context* ctx, ll_RenderCommandArray prev, ll_RenderCommandArray next) {
+  ll__Arena* arena = &ctx->arena;
+  uint64_t* prev_ids = LL__ARENA_ALLOC(arena, uint64_t, prev.length);
+  uint64_t* next_ids = LL__ARENA_ALLOC(arena, uint64_t, next.length);
+  if (prev_ids == NULL || next_ids == NULL || !ll__command_ids(arena, prev, prev_ids) ||
+      !ll__command_ids(arena, next, next_ids)) {
+    return (ll_DiffOpArray){0};
+  }
+
+  uint32_t mask = ll__diff_table_size(prev.length) - 1;
+  uint32_t* table = LL__ARENA_ALLOC(arena, uint32_t, mask + 1);
+  // the counterpart in `prev` of each command of `next`, or LL__NIL
+  uint32_t* matches = LL__ARENA_ALLOC(arena, uint32_t, next.length);
+  // for the longest run of matches that stayed in order: the last match of
+  // each length found so far, and the match before each
+  uint32_t* tails = LL__ARENA_ALLOC(arena, uint32_t, next.length);
+  uint32_t* before = LL__ARENA_ALLOC(arena, uint32_t, next.length);
+  bool* in_order = LL__ARENA_ALLOC(arena, bool, next.length);
+  bool* kept = LL__ARENA_ALLOC(arena, bool, prev.length);
+  ll_DiffOpArray ops = {.capacity = prev.length + 2 * next.length};
+  ops.internalArray = LL__ARENA_ALLOC(arena, ll_DiffOp, ops.capacity);
+  if (table == NULL || matches == NULL || tails == NULL || before == NULL || in_order == NULL || kept == NULL ||
+      ops.internalArray == NULL) {
+    return (ll_DiffOpArray){0};
+  }
+
+  for (uint32_t i = 0; i <= mask; i++) table[i] = LL__NIL;
+  for (uint32_t i = 0; i < prev.length; i++) {
+    uint32_t slot = (uint32_t)prev_ids[i] & mask;
+    while (table[slot] != LL__NIL) slot = (slot + 1) & mask;
+    table[slot] = i;
+    kept[i] = false;
+  }
+
+  // match, and find the longest increasing run of matches by patience sorting
+  uint32_t longest = 0;
+  for (uint32_t i = 0; i < next.length; i++) {
+    uint32_t slot = (uint32_t)next_ids[i] & mask;
+    while (table[slot] != LL__NIL && prev_ids[table[slot]] != next_ids[i]) slot = (slot + 1) & mask;
+    matches[i] = table[slot];
+    in_order[i] = false;
+    if (matches[i] == LL__NIL) continue;
+    kept[matches[i]] = true;
+
+    uint32_t low = 0, high = longest;
+    while (low < high) {
+      uint32_t mid = (low + high) / 2;
+      if (matches[tails[mid]] < matches[i]) low = mid + 1;
+      else high = mid;
+    }
+    before[i] = low > 0 ? tails[low - 1] : LL__NIL;
+    tails[low] = i;
+    if (low == longest) longest++;
+  }
+  for (uint32_t i = longest > 0 ? tails[longest - 1] : LL__NIL; i != LL__NIL; i = before[i]) in_order[i] = true;
+
+  for (uint32_t i = 0; i < prev.length; i++) {
+    if (!kept[i]) ops.internalArray[ops.length++] = (ll_DiffOp){LL_DIFF_OP_REMOVE, i, LL__NIL};
+  }
+  for (uint32_t i = 0; i < next.length; i++) {
+    uint32_t j = matches[i];
+    if (j == LL__NIL) {
+      ops.internalArray[ops.length++] = (ll_DiffOp){LL_DIFF_OP_INSERT, LL__NIL, i};
+      continue;
+    }
+    if (!in_order[i]) ops.internalArray[ops.length++] = (ll_DiffOp){LL_DIFF_OP_MOVE, j, i};
+    const ll_RenderCommand* a = &prev.internalArray[j];
+    const ll_RenderCommand* b = &next.internalArray[i];
+    if (!ll__same_command(a, b)) ops.internalArray[ops.length++] = (ll_DiffOp){LL_DIFF_OP_UPDATE, j, i};
+  }
+  return ops;
+}
+
+uint64_t ll_bin_commands_arena_size(uint32_t max_commands, ll_Size screen, uint32_t tile_size) {
+  if (tile_size == 0) return 0;
+  uint64_t tile_count = (uint64_t)((screen.width + (uint64_t)tile_size - 1) / tile_size) *
+                        ((screen.height + (uint64_t)tile_size - 1) / tile_size);
+  return LL__ARENA_FOOTPRINT(uint32_t, tile_count + 1)
+       + LL__ARENA_FOOTPRINT(ll__TileRange, max_commands)
+       + LL__ARENA_FOOTPRINT(ll__Rect, (uint64_t)max_commands + 1)
+       + LL__ARENA_FOOTPRINT(uint32_t, tile_count * max_commands);
+}
+
+ll_TileBins ll_bin_commands(ll_Context* ctx, ll_RenderCommandArray cmds, ll_Size screen, uint32_t tile_size) {
+  ll__Arena* arena = &ctx->arena;
+  if (tile_size == 0) return (ll_TileBins){0};
+  ll_TileBins bins = {
+      .screen = screen,
+      .tile_size = tile_size,
+      .columns = (uint32_t)((screen.width + (uint64_t)tile_size - 1) / tile_size),
+      .rows = (uint32_t)((screen.height + (uint64_t)tile_size - 1) / tile_size),
+  };
+  uint64_t tile_count = (uint64_t)bins.columns * bins.rows;
+  if (tile_count >= UINT32_MAX) return (ll_TileBins){0};
+  bins.offsets = LL__ARENA_ALLOC(arena, uint32_t, tile_count + 1);
+  ll__TileRange* ranges = LL__ARENA_ALLOC(arena, ll__TileRange, cmds.length);
+  // the clipped bounds of each open scissor, over the whole screen
+  ll__Rect* clips = LL__ARENA_ALLOC(arena, ll__Rect, (uint64_t)cmds.length + 1);
+  if (bins.offsets == NULL || ranges == NULL || clips == NULL) return (ll_TileBins){0};
+
+  // count the commands of tile t in offsets[t + 1]
+  for (uint64_t t = 0; t <= tile_count; t++) bins.offsets[t] = 0;
+  clips[0] = (ll__Rect){0, 0, screen.width, screen.height};
+  uint32_t depth = 0;
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < cmds.length; i++) {
+    const ll_RenderCommand* cmd = &cmds.internalArray[i];
+    // an end repeats the bounds of its start, so it is clipped by the scissor
+    // it closes and goes wherever its start went
+    ll__Rect clip = clips[depth];
+    ranges[i] = ll__tile_range(&bins, cmd->bounds, &clip);
+    if (cmd->tag == LL_RENDER_DATA_TAG_SCISSOR_START) clips[++depth] = clip;
+    if (cmd->tag == LL_RENDER_DATA_TAG_SCISSOR_END && depth > 0) depth--;
+    for (uint32_t y = ranges[i].y0; y < ranges[i].y1; y++) {
+      for (uint32_t x = ranges[i].x0; x < ranges[i].x1; x++) bins.offsets[(uint64_t)y * bins.columns + x + 1]++;
+    }
+    total += (uint64_t)(ranges[i].x1 - ranges[i].x0) * (ranges[i].y1 - ranges[i].y0);
+  }
+  if (total > UINT32_MAX) return (ll_TileBins){0};
+  bins.indices = LL__ARENA_ALLOC(arena, uint32_t, total);
+  if (bins.indices == NULL) return (ll_TileBins){0};
+
+  // turn the counts into the start of each tile, shifted along by one, then
+  // fill each tile, which leaves offsets[t + 1] at its end
+  uint32_t start = 0;
+  for (uint64_t t = 1; t <= tile_count; t++) {
+    uint32_t count = bins.offsets[t];
+    bins.offsets[t] = start;
+    start += count;
+  }
+  for (uint32_t i = 0; i < cmds.length; i++) {
+    for (uint32_t y = ranges[i].y0; y < ranges[i].y1; y++) {
+      for (uint32_t x = ranges[i].x0; x < ranges[i].x1; x++) {
+        bins.indices[bins.offsets[(uint64_t)y * bins.columns + x + 1]++] = i;
+      }
+    }
+  }
+  return bins;
+}
+
+ll_Bounds ll_tile_bounds(const ll_TileBins* bins, uint32_t tile) {
+  uint32_t x = tile % bins->columns * bins->tile_size, y = tile / bins->columns * bins->tile_size;
+  uint32_t width = bins->screen.width - x < bins->tile_size ? bins->screen.width - x : bins->tile_size;
+  uint32_t height = bins->screen.height - y < bins->tile_size ? bins->screen.height - y : bins->tile_size;
+  return (ll_Bounds){{(int32_t)x, (int32_t)y}, {width, height}};
+}
+
+bool ll_tile_damaged(const ll_TileBins* bins, uint32_t tile, ll_Damage damage) {
+  ll_Bounds bounds = ll_tile_bounds(bins, tile);
+  for (uint32_t i = 0; i < damage.rect_count; i++) {
+    if (ll__intersects(bounds, damage.rects[i])) return true;
+  }
+  return false;
 }
 
 
 // EXAMPLE =====================================================================
 
-#define SIZE 4096
+// Programs that include looseleaf.h for themselves, like those in bench/,
+// define LL_NO_EXAMPLE to leave this out
+#ifndef LL_NO_EXAMPLE
+
+#define SIZE 65536
+
+ll_Size measure_text(const char* text, uint16_t letter_spacing) {
+  uint32_t length = 0;
+  while (text[length] != '\0') length++;
+  return (ll_Size){.width = length * (6 + letter_spacing), .height = 8};
+}
+
+ll_Size measure_image(LL_IMAGE_TYPE* image) {
+  (void)image;
+  return (ll_Size){.width = 16, .height = 16};
+}
 
 int main() {
-  char arena[SIZE];
-  ll_Context ctx = ll_init(arena, SIZE);
-  ll_begin(&ctx);
+  static char arena[SIZE];
+  ll_set_text_measurement_fn(measure_text);
+  ll_set_image_measurement_fn(measure_image);
+  ll_configure_max_nodes(256);
+  ll_Context* ctx = ll_init(arena, SIZE);
+  ll_begin(ctx);
 
-  ll_NodeHandle im = ll_image(NULL, {.width = 1, .height = 1});
+  ll_NodeHandle im = ll_image(NULL, (ll_Size){.width = 1, .height = 1});
   ll_NodeHandle over = ll_overlay(
-      {.align_h = LL_HORIZ_ALIGN_LEFT},
-      ll_text({.letter_spacing = 3}, "hello world"),
-      ll_beside({.align_v = LL_VERT_ALIGN_CENTER}, im, im)
+      (ll_OverlayConfig){.align_h = LL_HORIZ_ALIGN_LEFT},
+      ll_text((ll_TextConfig){.letter_spacing = 3}, "hello world"),
+      ll_beside((ll_BesideConfig){.align_v = LL_VERT_ALIGN_CENTER}, im, im)
   );
 
   ll_RenderCommandArray cmds = ll_gen_commands(over);
+  (void)cmds;
 }
+
+#endif
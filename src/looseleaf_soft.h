@@ -0,0 +1,884 @@
+// looseleaf_soft.h: a software rasterizer for looseleaf's render commands
+//
+// Include this after looseleaf.h. It draws an ll_RenderCommandArray into a
+// framebuffer in memory, with no dependencies beyond the C standard library,
+// so that whole frames can be drawn (and timed) anywhere.
+
+#ifndef LL_HANDLE_INDEX_BITS
+#error "looseleaf_soft.h needs looseleaf.h to be included first"
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LL__SOFT_SSE2
+#endif
+// AVX2 kernels are compiled for any x86 target and used if the CPU has AVX2
+#if defined(LL__SOFT_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LL__SOFT_AVX2
+#endif
+
+//    +----------+
+//   /  HEADER  /
+// -+----------+----------------------------------------------------------------
+
+// Pack a color into a pixel of an RGBA8888 framebuffer, whose bytes are red,
+// green, blue and alpha in memory order (on a little-endian machine)
+#define LL_SOFT_RGBA(r, g, b, a) \
+  ((uint32_t)(r) | (uint32_t)(g) << 8 | (uint32_t)(b) << 16 | (uint32_t)(a) << 24)
+
+// The deepest nesting of scissors that is clipped exactly; scissors nested
+// deeper than this clip to the last one that fit
+#ifndef LL_SOFT_MAX_CLIP_DEPTH
+#define LL_SOFT_MAX_CLIP_DEPTH 32
+#endif
+
+typedef enum {
+  // 32 bits per pixel, as with LL_SOFT_RGBA
+  LL_SOFT_FORMAT_RGBA8888,
+  // 16 bits per pixel: 5 of red (the high bits), 6 of green and 5 of blue
+  LL_SOFT_FORMAT_RGB565,
+} ll_SoftFormat;
+
+typedef struct {
+  void* pixels;
+  uint32_t width;
+  uint32_t height;
+  // the number of bytes from the start of one row to the start of the next
+  uint32_t stride;
+  ll_SoftFormat format;
+} ll_SoftFramebuffer;
+
+// How an image is fitted to its command's bounds
+typedef enum {
+  // draw the image at its own size, cropped to the bounds
+  LL_SOFT_FILTER_NONE,
+  // scale the image to the bounds, taking the nearest pixel
+  LL_SOFT_FILTER_NEAREST,
+  // scale the image to the bounds, interpolating between pixels
+  LL_SOFT_FILTER_BILINEAR,
+} ll_SoftFilter;
+
+// The image an image render command's `imageData` points to: RGBA8888 pixels
+// (see LL_SOFT_RGBA) with straight alpha
+typedef struct {
+  const uint32_t* pixels;
+  uint32_t width;
+  uint32_t height;
+  // the number of pixels from the start of one row to the start of the next
+  uint32_t stride;
+  ll_SoftFilter filter;
+} ll_SoftImage;
+
+// An instruction set for the blend and scale kernels
+typedef enum {
+  // the best one this CPU supports, chosen when drawing starts
+  LL_SOFT_ISA_AUTO,
+  LL_SOFT_ISA_SCALAR,
+  LL_SOFT_ISA_SSE2,
+  LL_SOFT_ISA_AVX2,
+} ll_SoftIsa;
+
+// Where a cached run of text lies in the atlas
+typedef struct {
+  // zero for an empty slot
+  uint64_t key;
+  uint32_t x, y;
+  uint32_t width;
+} ll__SoftRun;
+
+// A text-run cache: the first time a run of text (its contents, letter spacing
+// or glyph offsets, and color) is drawn, it is drawn into an RGBA8888 atlas, on shelves one
+// glyph high, and from then on it is blended from there a row at a time. When
+// the atlas or the table of runs fills up, every run is evicted at once.
+typedef struct {
+  uint32_t* atlas;
+  ll_Size atlas_size;
+  // the top of the shelf being filled, and the first free column on it
+  uint32_t shelf_y;
+  uint32_t shelf_x;
+  ll__SoftRun* runs;
+  uint32_t run_mask;
+  uint32_t run_count;
+  uint32_t max_runs;
+  ll_CacheStats stats;
+} ll_SoftTextCache;
+
+// The size of a character of the built-in font, including a column and a row
+// of spacing
+#define LL_SOFT_GLYPH_WIDTH 6
+#define LL_SOFT_GLYPH_HEIGHT 8
+
+// Measure `text` as the built-in font draws it, for ll_set_text_measurement_fn
+ll_Size ll_soft_measure_text(const char* text, uint16_t letter_spacing);
+// Measure `text` and write the offset of each glyph, for
+// ll_set_glyph_measurement_fn
+ll_Size ll_soft_measure_glyphs(const char* text, uint16_t letter_spacing, int32_t* glyph_x);
+// Measure an ll_SoftImage, for ll_set_image_measurement_fn
+ll_Size ll_soft_measure_image(LL_IMAGE_TYPE* image);
+// Fill the whole framebuffer with `color` (see LL_SOFT_RGBA)
+void ll_soft_clear(ll_SoftFramebuffer* fb, uint32_t color);
+// Draw `cmds` into the framebuffer, blending images over what is there and
+// drawing text in `text_color` with the built-in 5x7 font. Characters outside
+// printable ASCII are drawn as blanks.
+void ll_soft_render(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, uint32_t text_color);
+// Draw the commands of tile `tile` of `bins` (see ll_bin_commands), clipped to
+// the tile. Different tiles can be drawn on different threads at once.
+void ll_soft_render_tile(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, const ll_TileBins* bins, uint32_t tile,
+                         uint32_t text_color);
+// Return the number of bytes a text-run cache with an atlas of `atlas_size`
+// pixels and room for `max_runs` runs takes up
+uint64_t ll_soft_text_cache_size(ll_Size atlas_size, uint32_t max_runs);
+// Initialize a text-run cache in `mem`, which it lives in; returns NULL if
+// `capacity` bytes are too few
+ll_SoftTextCache* ll_soft_text_cache_init(char* mem, size_t capacity, ll_Size atlas_size, uint32_t max_runs);
+// Draw text through `cache`, or glyph by glyph again if it's NULL. Only
+// translucent text in RGBA8888 framebuffers goes through the cache, since
+// opaque glyphs and RGB565 pixels are plotted as fast as a run is blended.
+// Runs wider than the atlas, and runs whose glyphs overlap (with negative
+// letter spacing or glyph offsets, which would blend twice where they do) or
+// start left of the bounds, are always drawn glyph by glyph too. Runs with
+// glyph offsets are cached by their offsets.
+// ll_soft_render adds the runs it draws to the cache; ll_soft_render_tile only
+// reads it, so that tiles can be drawn concurrently, and draws runs it doesn't
+// find glyph by glyph.
+void ll_soft_set_text_cache(ll_SoftTextCache* cache);
+// Add the text of `cmds`, in `text_color`, to the text-run cache, e.g. before
+// drawing tiles. If it doesn't all fit, what was added last is kept.
+void ll_soft_cache_text(ll_RenderCommandArray cmds, uint32_t text_color);
+// Return the hit, miss and eviction counts of the text-run cache, counting
+// the lookups of ll_soft_render and ll_soft_cache_text
+ll_CacheStats ll_soft_text_cache_stats(const ll_SoftTextCache* cache);
+// Use the kernels for `isa`, e.g. to compare them. Returns false, changing
+// nothing, if this build or CPU can't run them.
+bool ll_soft_set_isa(ll_SoftIsa isa);
+// Return the instruction set the kernels will use, never LL_SOFT_ISA_AUTO
+ll_SoftIsa ll_soft_isa(void);
+
+
+//    +------------------+
+//   /  IMPLEMENTATION  /
+// -+------------------+--------------------------------------------------------
+
+// built-in font ===============================================================
+
+// The printable ASCII characters, from ' ', as 5 columns of 7 pixels each,
+// the top pixel in the lowest bit
+const uint8_t ll__soft_font[95][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7f, 0x14, 0x7f, 0x14}, {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1c, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1c, 0x00}, {0x08, 0x2a, 0x1c, 0x2a, 0x08}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31}, {0x18, 0x14, 0x12, 0x7f, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3e},
+    {0x7e, 0x11, 0x11, 0x11, 0x7e}, {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41}, {0x7f, 0x09, 0x09, 0x09, 0x01},
+    {0x3e, 0x41, 0x49, 0x49, 0x7a}, {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41}, {0x7f, 0x40, 0x40, 0x40, 0x40},
+    {0x7f, 0x02, 0x0c, 0x02, 0x7f}, {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e}, {0x7f, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x3f, 0x40, 0x38, 0x40, 0x3f}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7f, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7f, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7f, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7f},
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7e, 0x09, 0x01, 0x02}, {0x0c, 0x52, 0x52, 0x52, 0x3e},
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7d, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3d, 0x00},
+    {0x7f, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7f, 0x40, 0x00}, {0x7c, 0x04, 0x18, 0x04, 0x78},
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7c, 0x14, 0x14, 0x14, 0x08},
+    {0x08, 0x14, 0x14, 0x18, 0x7c}, {0x7c, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3f, 0x44, 0x40, 0x20}, {0x3c, 0x40, 0x40, 0x20, 0x7c}, {0x1c, 0x20, 0x40, 0x20, 0x1c},
+    {0x3c, 0x40, 0x30, 0x40, 0x3c}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0c, 0x50, 0x50, 0x50, 0x3c},
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7f, 0x00, 0x00},
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08},
+};
+
+// pixel formats ===============================================================
+
+// Divide `x`, up to 255 * 255, by 255, rounding to nearest
+uint32_t ll__soft_div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+// Blend the straight-alpha RGBA8888 pixel `src` over `dst`
+uint32_t ll__soft_blend(uint32_t dst, uint32_t src) {
+  uint32_t a = src >> 24;
+  uint32_t out = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 8) {
+    // alpha blends as if the source were opaque in that channel
+    uint32_t s = shift == 24 ? 255 : (src >> shift) & 0xff;
+    uint32_t d = (dst >> shift) & 0xff;
+    out |= (ll__soft_div255(s * a) + ll__soft_div255(d * (255 - a))) << shift;
+  }
+  return out;
+}
+
+uint32_t ll__soft_from_rgb565(uint16_t pixel) {
+  uint32_t r = pixel >> 11, g = (pixel >> 5) & 0x3f, b = pixel & 0x1f;
+  return LL_SOFT_RGBA(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255);
+}
+
+uint16_t ll__soft_to_rgb565(uint32_t pixel) {
+  return (uint16_t)(((pixel & 0xf8) << 8) | ((pixel >> 5) & 0x7e0) | ((pixel >> 19) & 0x1f));
+}
+
+// kernels =====================================================================
+
+// The number of destination pixels the kernels handle at once
+#define LL__SOFT_CHUNK 256
+
+// Every set of kernels gives the same results, bit for bit:
+// - blend_row blends `count` straight-alpha pixels from `src` over `dst`
+// - nearest_row gathers src[xs[i]] into dst[i]
+// - bilinear_row interpolates between `top` and `bottom` at columns x0[i] and
+//   x1[i], with weights fx[i] and `fy` out of 256 for x1 and `bottom`
+typedef struct {
+  void (*blend_row)(uint32_t* dst, const uint32_t* src, uint32_t count);
+  void (*nearest_row)(uint32_t* dst, const uint32_t* src, const uint32_t* xs, uint32_t count);
+  void (*bilinear_row)(uint32_t* dst, const uint32_t* top, const uint32_t* bottom, const uint32_t* x0,
+                       const uint32_t* x1, const uint32_t* fx, uint32_t fy, uint32_t count);
+} ll__SoftKernels;
+
+ll_SoftIsa ll__soft_isa = LL_SOFT_ISA_AUTO;
+
+// Interpolate each channel of `a` towards `b` by `t` out of 256
+uint32_t ll__soft_lerp(uint32_t a, uint32_t b, uint32_t t) {
+  uint32_t out = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 8) {
+    uint32_t ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+    out |= ((ca * (256 - t) + cb * t) >> 8) << shift;
+  }
+  return out;
+}
+
+void ll__soft_blend_row_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t a = src[i] >> 24;
+    if (a == 255) dst[i] = src[i];
+    else if (a != 0) dst[i] = ll__soft_blend(dst[i], src[i]);
+  }
+}
+
+void ll__soft_nearest_row_scalar(uint32_t* dst, const uint32_t* src, const uint32_t* xs, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) dst[i] = src[xs[i]];
+}
+
+void ll__soft_bilinear_row_scalar(uint32_t* dst, const uint32_t* top, const uint32_t* bottom, const uint32_t* x0,
+                                  const uint32_t* x1, const uint32_t* fx, uint32_t fy, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t upper = ll__soft_lerp(top[x0[i]], top[x1[i]], fx[i]);
+    uint32_t lower = ll__soft_lerp(bottom[x0[i]], bottom[x1[i]], fx[i]);
+    dst[i] = ll__soft_lerp(upper, lower, fy);
+  }
+}
+
+#ifdef LL__SOFT_SSE2
+void ll__soft_blend_row_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+  const __m128i alpha_lanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i ones = _mm_set1_epi16(255);
+  const __m128i bias = _mm_set1_epi16(128);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i a = _mm_and_si128(s, alpha_mask);
+    // skip runs that are entirely transparent, copy opaque ones, and select
+    // between the two when every pixel is one or the other
+    __m128i clear = _mm_cmpeq_epi32(a, zero), opaque = _mm_cmpeq_epi32(a, alpha_mask);
+    if (_mm_movemask_epi8(clear) == 0xffff) continue;
+    if (_mm_movemask_epi8(opaque) == 0xffff) {
+      _mm_storeu_si128((__m128i*)(dst + i), s);
+      continue;
+    }
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    if (_mm_movemask_epi8(_mm_or_si128(clear, opaque)) == 0xffff) {
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, d)));
+      continue;
+    }
+    __m128i halves[2];
+    for (int half = 0; half < 2; half++) {
+      __m128i s16 = half == 0 ? _mm_unpacklo_epi8(s, zero) : _mm_unpackhi_epi8(s, zero);
+      __m128i d16 = half == 0 ? _mm_unpacklo_epi8(d, zero) : _mm_unpackhi_epi8(d, zero);
+      __m128i a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0xff), 0xff);
+      s16 = _mm_or_si128(s16, alpha_lanes);
+      __m128i sa = _mm_add_epi16(_mm_mullo_epi16(s16, a16), bias);
+      __m128i da = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(ones, a16)), bias);
+      sa = _mm_srli_epi16(_mm_add_epi16(sa, _mm_srli_epi16(sa, 8)), 8);
+      da = _mm_srli_epi16(_mm_add_epi16(da, _mm_srli_epi16(da, 8)), 8);
+      halves[half] = _mm_add_epi16(sa, da);
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(halves[0], halves[1]));
+  }
+  ll__soft_blend_row_scalar(dst + i, src + i, count - i);
+}
+
+// Interpolate the 16-bit channels of `a` towards `b` by the weights `t`
+__m128i ll__soft_lerp_sse2(__m128i a, __m128i b, __m128i t) {
+  __m128i inv = _mm_sub_epi16(_mm_set1_epi16(256), t);
+  return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, inv), _mm_mullo_epi16(b, t)), 8);
+}
+
+void ll__soft_bilinear_row_sse2(uint32_t* dst, const uint32_t* top, const uint32_t* bottom, const uint32_t* x0,
+                                const uint32_t* x1, const uint32_t* fx, uint32_t fy, uint32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i fy16 = _mm_set1_epi16((short)fy);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint32_t* a = x0 + i;
+    const uint32_t* b = x1 + i;
+    __m128i tl = _mm_set_epi32((int)top[a[3]], (int)top[a[2]], (int)top[a[1]], (int)top[a[0]]);
+    __m128i tr = _mm_set_epi32((int)top[b[3]], (int)top[b[2]], (int)top[b[1]], (int)top[b[0]]);
+    __m128i bl = _mm_set_epi32((int)bottom[a[3]], (int)bottom[a[2]], (int)bottom[a[1]], (int)bottom[a[0]]);
+    __m128i br = _mm_set_epi32((int)bottom[b[3]], (int)bottom[b[2]], (int)bottom[b[1]], (int)bottom[b[0]]);
+    // spread each pixel's weight over its four 16-bit channels
+    __m128i w = _mm_loadu_si128((const __m128i*)(fx + i));
+    w = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+    __m128i halves[2];
+    for (int half = 0; half < 2; half++) {
+      __m128i fx16 = half == 0 ? _mm_unpacklo_epi32(w, w) : _mm_unpackhi_epi32(w, w);
+      __m128i upper, lower;
+      if (half == 0) {
+        upper = ll__soft_lerp_sse2(_mm_unpacklo_epi8(tl, zero), _mm_unpacklo_epi8(tr, zero), fx16);
+        lower = ll__soft_lerp_sse2(_mm_unpacklo_epi8(bl, zero), _mm_unpacklo_epi8(br, zero), fx16);
+      } else {
+        upper = ll__soft_lerp_sse2(_mm_unpackhi_epi8(tl, zero), _mm_unpackhi_epi8(tr, zero), fx16);
+        lower = ll__soft_lerp_sse2(_mm_unpackhi_epi8(bl, zero), _mm_unpackhi_epi8(br, zero), fx16);
+      }
+      halves[half] = ll__soft_lerp_sse2(upper, lower, fy16);
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(halves[0], halves[1]));
+  }
+  ll__soft_bilinear_row_scalar(dst + i, top, bottom, x0 + i, x1 + i, fx + i, fy, count - i);
+}
+
+void ll__soft_nearest_row_sse2(uint32_t* dst, const uint32_t* src, const uint32_t* xs, uint32_t count) {
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint32_t* x = xs + i;
+    // SSE2 has no gather, but four neighbouring columns, as when cropping, are
+    // one load
+    __m128i pixels;
+    if (x[3] - x[0] == 3 && x[1] - x[0] == 1 && x[2] - x[0] == 2) {
+      pixels = _mm_loadu_si128((const __m128i*)(src + x[0]));
+    } else {
+      pixels = _mm_set_epi32((int)src[x[3]], (int)src[x[2]], (int)src[x[1]], (int)src[x[0]]);
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), pixels);
+  }
+  ll__soft_nearest_row_scalar(dst + i, src, xs + i, count - i);
+}
+#endif
+
+#ifdef LL__SOFT_AVX2
+__attribute__((target("avx2"))) void ll__soft_blend_row_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+  const __m256i alpha_lanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+  const __m256i ones = _mm256_set1_epi16(255);
+  const __m256i bias = _mm256_set1_epi16(128);
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i a = _mm256_and_si256(s, alpha_mask);
+    __m256i clear = _mm256_cmpeq_epi32(a, zero), opaque = _mm256_cmpeq_epi32(a, alpha_mask);
+    if (_mm256_movemask_epi8(clear) == -1) continue;
+    if (_mm256_movemask_epi8(opaque) == -1) {
+      _mm256_storeu_si256((__m256i*)(dst + i), s);
+      continue;
+    }
+    __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+    if (_mm256_movemask_epi8(_mm256_or_si256(clear, opaque)) == -1) {
+      _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(d, s, opaque));
+      continue;
+    }
+    // unpacking and packing work within 128-bit lanes, so pixel order holds
+    __m256i halves[2];
+    for (int half = 0; half < 2; half++) {
+      __m256i s16 = half == 0 ? _mm256_unpacklo_epi8(s, zero) : _mm256_unpackhi_epi8(s, zero);
+      __m256i d16 = half == 0 ? _mm256_unpacklo_epi8(d, zero) : _mm256_unpackhi_epi8(d, zero);
+      __m256i a16 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, 0xff), 0xff);
+      s16 = _mm256_or_si256(s16, alpha_lanes);
+      __m256i sa = _mm256_add_epi16(_mm256_mullo_epi16(s16, a16), bias);
+      __m256i da = _mm256_add_epi16(_mm256_mullo_epi16(d16, _mm256_sub_epi16(ones, a16)), bias);
+      sa = _mm256_srli_epi16(_mm256_add_epi16(sa, _mm256_srli_epi16(sa, 8)), 8);
+      da = _mm256_srli_epi16(_mm256_add_epi16(da, _mm256_srli_epi16(da, 8)), 8);
+      halves[half] = _mm256_add_epi16(sa, da);
+    }
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(halves[0], halves[1]));
+  }
+  ll__soft_blend_row_sse2(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2"))) void ll__soft_nearest_row_avx2(uint32_t* dst, const uint32_t* src, const uint32_t* xs,
+                                                               uint32_t count) {
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i index = _mm256_loadu_si256((const __m256i*)(xs + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)src, index, 4));
+  }
+  ll__soft_nearest_row_scalar(dst + i, src, xs + i, count - i);
+}
+
+__attribute__((target("avx2"))) __m256i ll__soft_lerp_avx2(__m256i a, __m256i b, __m256i t) {
+  __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(256), t);
+  return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, inv), _mm256_mullo_epi16(b, t)), 8);
+}
+
+__attribute__((target("avx2"))) void ll__soft_bilinear_row_avx2(uint32_t* dst, const uint32_t* top,
+                                                                const uint32_t* bottom, const uint32_t* x0,
+                                                                const uint32_t* x1, const uint32_t* fx, uint32_t fy,
+                                                                uint32_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i fy16 = _mm256_set1_epi16((short)fy);
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(x0 + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(x1 + i));
+    __m256i tl = _mm256_i32gather_epi32((const int*)top, a, 4);
+    __m256i tr = _mm256_i32gather_epi32((const int*)top, b, 4);
+    __m256i bl = _mm256_i32gather_epi32((const int*)bottom, a, 4);
+    __m256i br = _mm256_i32gather_epi32((const int*)bottom, b, 4);
+    __m256i w = _mm256_loadu_si256((const __m256i*)(fx + i));
+    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+    __m256i halves[2];
+    for (int half = 0; half < 2; half++) {
+      __m256i fx16 = half == 0 ? _mm256_unpacklo_epi32(w, w) : _mm256_unpackhi_epi32(w, w);
+      __m256i upper, lower;
+      if (half == 0) {
+        upper = ll__soft_lerp_avx2(_mm256_unpacklo_epi8(tl, zero), _mm256_unpacklo_epi8(tr, zero), fx16);
+        lower = ll__soft_lerp_avx2(_mm256_unpacklo_epi8(bl, zero), _mm256_unpacklo_epi8(br, zero), fx16);
+      } else {
+        upper = ll__soft_lerp_avx2(_mm256_unpackhi_epi8(tl, zero), _mm256_unpackhi_epi8(tr, zero), fx16);
+        lower = ll__soft_lerp_avx2(_mm256_unpackhi_epi8(bl, zero), _mm256_unpackhi_epi8(br, zero), fx16);
+      }
+      halves[half] = ll__soft_lerp_avx2(upper, lower, fy16);
+    }
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(halves[0], halves[1]));
+  }
+  ll__soft_bilinear_row_sse2(dst + i, top, bottom, x0 + i, x1 + i, fx + i, fy, count - i);
+}
+#endif
+
+// Return the kernels for `isa`, or NULL if they can't run here
+const ll__SoftKernels* ll__soft_kernels_for(ll_SoftIsa isa) {
+  static const ll__SoftKernels scalar = {
+      ll__soft_blend_row_scalar, ll__soft_nearest_row_scalar, ll__soft_bilinear_row_scalar};
+  switch (isa) {
+  case LL_SOFT_ISA_AUTO:
+    return ll__soft_kernels_for(ll_soft_isa());
+  case LL_SOFT_ISA_SCALAR:
+    return &scalar;
+#ifdef LL__SOFT_SSE2
+  case LL_SOFT_ISA_SSE2: {
+    static const ll__SoftKernels sse2 = {
+        ll__soft_blend_row_sse2, ll__soft_nearest_row_sse2, ll__soft_bilinear_row_sse2};
+    return &sse2;
+  }
+#endif
+#ifdef LL__SOFT_AVX2
+  case LL_SOFT_ISA_AVX2: {
+    static const ll__SoftKernels avx2 = {
+        ll__soft_blend_row_avx2, ll__soft_nearest_row_avx2, ll__soft_bilinear_row_avx2};
+    return __builtin_cpu_supports("avx2") ? &avx2 : NULL;
+  }
+#endif
+  default:
+    return NULL;
+  }
+}
+
+// drawing =====================================================================
+
+// A rectangle of pixels, from (x0, y0) up to but not including (x1, y1)
+typedef struct {
+  int64_t x0, y0, x1, y1;
+} ll__SoftRect;
+
+ll__SoftRect ll__soft_intersect(ll__SoftRect a, ll__SoftRect b) {
+  ll__SoftRect r = {
+      a.x0 > b.x0 ? a.x0 : b.x0,
+      a.y0 > b.y0 ? a.y0 : b.y0,
+      a.x1 < b.x1 ? a.x1 : b.x1,
+      a.y1 < b.y1 ? a.y1 : b.y1,
+  };
+  if (r.x1 < r.x0) r.x1 = r.x0;
+  if (r.y1 < r.y0) r.y1 = r.y0;
+  return r;
+}
+
+ll__SoftRect ll__soft_rect(ll_Bounds bounds) {
+  return (ll__SoftRect){
+      bounds.posn.x,
+      bounds.posn.y,
+      (int64_t)bounds.posn.x + bounds.size.width,
+      (int64_t)bounds.posn.y + bounds.size.height,
+  };
+}
+
+// Blend `count` pixels from `src` over the framebuffer, starting at (`x`, `y`)
+void ll__soft_composite(ll_SoftFramebuffer* fb, const ll__SoftKernels* k, int64_t x, int64_t y, const uint32_t* src,
+                        uint32_t count) {
+  char* row = (char*)fb->pixels + (size_t)y * fb->stride;
+  if (fb->format == LL_SOFT_FORMAT_RGBA8888) {
+    k->blend_row((uint32_t*)row + x, src, count);
+    return;
+  }
+  // widen each run of pixels that aren't transparent, which is lossless, and
+  // narrow it again after blending
+  uint16_t* dst = (uint16_t*)row + x;
+  uint32_t wide[LL__SOFT_CHUNK];
+  for (uint32_t start = 0, end; start < count; start = end) {
+    if (src[start] >> 24 == 0) {
+      end = start + 1;
+      continue;
+    }
+    for (end = start; end < count && src[end] >> 24 != 0; end++) wide[end] = ll__soft_from_rgb565(dst[end]);
+    k->blend_row(wide + start, src + start, end - start);
+    for (uint32_t i = start; i < end; i++) dst[i] = ll__soft_to_rgb565(wide[i]);
+  }
+}
+
+// Map a destination pixel `i` of `dst_size` to the source, in 1/256ths of a
+// pixel, so that pixel centers line up
+int64_t ll__soft_sample_posn(int64_t i, uint32_t src_size, uint32_t dst_size) {
+  return (int64_t)((2 * i + 1) * src_size * 256 / (2 * (int64_t)dst_size)) - 128;
+}
+
+// Draw `image` into `dest`, inside `clip`, a column of chunks at a time
+void ll__soft_draw_image(ll_SoftFramebuffer* fb, const ll__SoftKernels* k, const ll_SoftImage* image,
+                         ll__SoftRect dest, ll__SoftRect clip) {
+  if (image->width == 0 || image->height == 0) return;
+  if (image->filter == LL_SOFT_FILTER_NONE) {
+    if (dest.x1 > dest.x0 + image->width) dest.x1 = dest.x0 + image->width;
+    if (dest.y1 > dest.y0 + image->height) dest.y1 = dest.y0 + image->height;
+  }
+  clip = ll__soft_intersect(clip, dest);
+  uint32_t dest_width = (uint32_t)(dest.x1 - dest.x0), dest_height = (uint32_t)(dest.y1 - dest.y0);
+  uint32_t samples[LL__SOFT_CHUNK], x0[LL__SOFT_CHUNK], x1[LL__SOFT_CHUNK], fx[LL__SOFT_CHUNK];
+
+  for (int64_t x = clip.x0; x < clip.x1; x += LL__SOFT_CHUNK) {
+    uint32_t count = (uint32_t)(clip.x1 - x < LL__SOFT_CHUNK ? clip.x1 - x : LL__SOFT_CHUNK);
+    // the source columns are the same for every row
+    for (uint32_t i = 0; i < count && image->filter != LL_SOFT_FILTER_NONE; i++) {
+      int64_t posn = ll__soft_sample_posn(x + i - dest.x0, image->width, dest_width);
+      if (image->filter == LL_SOFT_FILTER_NEAREST) {
+        x0[i] = (uint32_t)((posn + 128) >> 8);
+        continue;
+      }
+      if (posn < 0) posn = 0;
+      x0[i] = (uint32_t)(posn >> 8);
+      fx[i] = (uint32_t)(posn & 0xff);
+      if (x0[i] >= image->width - 1) x0[i] = image->width - 1, fx[i] = 0;
+      x1[i] = x0[i] + (x0[i] < image->width - 1);
+    }
+
+    for (int64_t y = clip.y0; y < clip.y1; y++) {
+      const uint32_t* src;
+      if (image->filter == LL_SOFT_FILTER_NONE) {
+        src = image->pixels + (size_t)(y - dest.y0) * image->stride + (x - dest.x0);
+      } else if (image->filter == LL_SOFT_FILTER_NEAREST) {
+        int64_t row = (ll__soft_sample_posn(y - dest.y0, image->height, dest_height) + 128) >> 8;
+        k->nearest_row(samples, image->pixels + (size_t)row * image->stride, x0, count);
+        src = samples;
+      } else {
+        int64_t posn = ll__soft_sample_posn(y - dest.y0, image->height, dest_height);
+        if (posn < 0) posn = 0;
+        uint32_t row = (uint32_t)(posn >> 8), fy = (uint32_t)(posn & 0xff);
+        if (row >= image->height - 1) row = image->height - 1, fy = 0;
+        const uint32_t* top = image->pixels + (size_t)row * image->stride;
+        const uint32_t* bottom = top + (row < image->height - 1 ? image->stride : 0);
+        k->bilinear_row(samples, top, bottom, x0, x1, fx, fy, count);
+        src = samples;
+      }
+      ll__soft_composite(fb, k, x, y, src, count);
+    }
+  }
+}
+
+// Blend `color` over the pixel at (`x`, `y`)
+void ll__soft_plot(ll_SoftFramebuffer* fb, uint32_t x, uint32_t y, uint32_t color) {
+  char* row = (char*)fb->pixels + (size_t)y * fb->stride;
+  if (fb->format == LL_SOFT_FORMAT_RGBA8888) {
+    ll__soft_blend_row_scalar((uint32_t*)row + x, &color, 1);
+  } else {
+    uint16_t* pixel = (uint16_t*)row + x;
+    uint32_t wide = ll__soft_from_rgb565(*pixel);
+    ll__soft_blend_row_scalar(&wide, &color, 1);
+    *pixel = ll__soft_to_rgb565(wide);
+  }
+}
+
+// Draw `text` with its top-left corner at (`left`, `y`), inside `clip`, with
+// its glyphs at `glyph_x` if it isn't NULL
+void ll__soft_draw_text(ll_SoftFramebuffer* fb, const char* text, int16_t letter_spacing, const int32_t* glyph_x,
+                        int64_t left, int64_t y, uint32_t color, ll__SoftRect clip) {
+  if (y >= clip.y1 || y + LL_SOFT_GLYPH_HEIGHT <= clip.y0) return;
+  for (int64_t i = 0; text[i] != '\0'; i++) {
+    int64_t x = left + (glyph_x != NULL ? glyph_x[i] : i * (LL_SOFT_GLYPH_WIDTH + letter_spacing));
+    if (x >= clip.x1 && glyph_x == NULL) break;
+    unsigned char c = (unsigned char)text[i];
+    if (c < ' ' || c > '~' || x + LL_SOFT_GLYPH_WIDTH <= clip.x0) continue;
+    const uint8_t* glyph = ll__soft_font[c - ' '];
+    for (int64_t column = 0; column < 5; column++) {
+      if (x + column < clip.x0 || x + column >= clip.x1) continue;
+      for (int64_t row = 0; row < 7; row++) {
+        if ((glyph[column] >> row & 1) && y + row >= clip.y0 && y + row < clip.y1) {
+          ll__soft_plot(fb, (uint32_t)(x + column), (uint32_t)(y + row), color);
+        }
+      }
+    }
+  }
+}
+
+// text-run cache ==============================================================
+
+ll_SoftTextCache* ll__soft_text_cache = NULL;
+
+// Forget every run in `cache`
+void ll__soft_evict_runs(ll_SoftTextCache* cache) {
+  for (uint32_t i = 0; i <= cache->run_mask; i++) cache->runs[i].key = 0;
+  cache->stats.evictions += cache->run_count;
+  cache->run_count = 0;
+  cache->shelf_x = cache->shelf_y = 0;
+}
+
+// Draw `text` into the atlas of `cache` at `run`, with the glyph of each byte
+// `advance` pixels after the last, or at `glyph_x` if it isn't NULL
+void ll__soft_draw_run(ll_SoftTextCache* cache, const ll__SoftRun* run, const char* text, int64_t advance,
+                       const int32_t* glyph_x, uint32_t color) {
+  uint32_t* origin = cache->atlas + (size_t)run->y * cache->atlas_size.width + run->x;
+  for (uint32_t row = 0; row < LL_SOFT_GLYPH_HEIGHT; row++) {
+    for (uint32_t x = 0; x < run->width; x++) origin[(size_t)row * cache->atlas_size.width + x] = 0;
+  }
+  for (int64_t i = 0; text[i] != '\0'; i++) {
+    int64_t x = glyph_x != NULL ? glyph_x[i] : i * advance;
+    unsigned char c = (unsigned char)text[i];
+    if (c < ' ' || c > '~') continue;
+    const uint8_t* glyph = ll__soft_font[c - ' '];
+    for (int64_t column = 0; column < 5 && x + column < run->width; column++) {
+      for (uint32_t row = 0; row < 7; row++) {
+        if (glyph[column] >> row & 1) origin[(size_t)row * cache->atlas_size.width + x + column] = color;
+      }
+    }
+  }
+}
+
+// Return the run of `text` in `cache`, adding it if `add` is set, or NULL if
+// it isn't there
+const ll__SoftRun* ll__soft_find_run(ll_SoftTextCache* cache, const ll_TextRenderData* text, uint32_t color,
+                                     bool add) {
+  // opaque glyphs are plotted faster than a run is blended
+  if (color >> 24 == 255) return NULL;
+  // a run bitmap would keep only the last of two overlapping glyphs' pixels,
+  // and can't hold glyphs left of the bounds
+  int64_t advance = LL_SOFT_GLYPH_WIDTH + text->letter_spacing;
+  uint64_t length = strlen(text->text);
+  uint64_t width = length * (uint64_t)advance;
+  if (text->glyph_x != NULL) {
+    for (uint64_t i = 0; i < length; i++) {
+      if (text->glyph_x[i] < (i == 0 ? 0 : (int64_t)text->glyph_x[i - 1] + LL_SOFT_GLYPH_WIDTH)) return NULL;
+    }
+    width = length > 0 ? (uint64_t)text->glyph_x[length - 1] + LL_SOFT_GLYPH_WIDTH : 0;
+  } else if (advance < LL_SOFT_GLYPH_WIDTH) {
+    return NULL;
+  }
+  // the key ll_enable_text_hashes already computed, if it did
+  uint64_t key = text->text_hash != 0 ? text->text_hash : ll__text_key(text->text, (uint16_t)text->letter_spacing);
+  if (text->glyph_x != NULL) key = ll__hash_bytes(key, text->glyph_x, (uint32_t)(length * sizeof(int32_t)));
+  key = ll__mix64(key ^ color);
+  if (key == 0) key = 1;
+  uint32_t slot = (uint32_t)key & cache->run_mask;
+  while (cache->runs[slot].key != 0 && cache->runs[slot].key != key) slot = (slot + 1) & cache->run_mask;
+  if (cache->runs[slot].key == key) {
+    if (add) cache->stats.hits++;
+    return &cache->runs[slot];
+  }
+  if (!add) return NULL;
+  cache->stats.misses++;
+
+  if (width == 0 || width > cache->atlas_size.width || cache->atlas_size.height < LL_SOFT_GLYPH_HEIGHT) return NULL;
+  if (cache->shelf_x + width > cache->atlas_size.width) {
+    cache->shelf_x = 0;
+    cache->shelf_y += LL_SOFT_GLYPH_HEIGHT;
+  }
+  if (cache->run_count == cache->max_runs || cache->shelf_y + LL_SOFT_GLYPH_HEIGHT > cache->atlas_size.height) {
+    ll__soft_evict_runs(cache);
+    slot = (uint32_t)key & cache->run_mask;
+  }
+
+  ll__SoftRun* run = &cache->runs[slot];
+  *run = (ll__SoftRun){key, cache->shelf_x, cache->shelf_y, (uint32_t)width};
+  cache->shelf_x += (uint32_t)width;
+  cache->run_count++;
+  ll__soft_draw_run(cache, run, text->text, advance, text->glyph_x, color);
+  return run;
+}
+
+// Draw the `count` commands of `cmds` at `indices`, or the first `count` if
+// `indices` is NULL, inside `clip`
+void ll__soft_render(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, const uint32_t* indices, uint32_t count,
+                     ll__SoftRect clip, uint32_t text_color) {
+  // clips[depth] is the region drawn into, within every open scissor
+  ll__SoftRect clips[LL_SOFT_MAX_CLIP_DEPTH + 1] = {clip};
+  uint32_t depth = 0, overflow = 0;
+  const ll__SoftKernels* kernels = ll__soft_kernels_for(ll__soft_isa);
+
+  for (uint32_t i = 0; i < count; i++) {
+    const ll_RenderCommand* cmd = &cmds.internalArray[indices != NULL ? indices[i] : i];
+    clip = ll__soft_intersect(clips[depth], ll__soft_rect(cmd->bounds));
+    switch (cmd->tag) {
+    case LL_RENDER_DATA_TAG_IMAGE: {
+      const ll_SoftImage* image = (const ll_SoftImage*)cmd->render_data.image_render_data.imageData;
+      if (image != NULL) ll__soft_draw_image(fb, kernels, image, ll__soft_rect(cmd->bounds), clips[depth]);
+      break;
+    }
+    case LL_RENDER_DATA_TAG_TEXT: {
+      const ll_TextRenderData* text = &cmd->render_data.text_render_data;
+      const ll__SoftRun* run = NULL;
+      // widening an RGB565 row around every few lit pixels of a run costs what
+      // plotting them does
+      if (ll__soft_text_cache != NULL && fb->format == LL_SOFT_FORMAT_RGBA8888) {
+        run = ll__soft_find_run(ll__soft_text_cache, text, text_color, indices == NULL);
+      }
+      if (run != NULL) {
+        const ll_SoftTextCache* cache = ll__soft_text_cache;
+        ll_SoftImage image = {
+            .pixels = cache->atlas + (size_t)run->y * cache->atlas_size.width + run->x,
+            .width = run->width,
+            // the bottom row is spacing
+            .height = LL_SOFT_GLYPH_HEIGHT - 1,
+            .stride = cache->atlas_size.width,
+        };
+        ll__soft_draw_image(fb, kernels, &image, ll__soft_rect(cmd->bounds), clips[depth]);
+        break;
+      }
+      ll__soft_draw_text(fb, text->text, text->letter_spacing, text->glyph_x, cmd->bounds.posn.x, cmd->bounds.posn.y,
+                         text_color, clip);
+      break;
+    }
+    case LL_RENDER_DATA_TAG_SCISSOR_START:
+      if (depth < LL_SOFT_MAX_CLIP_DEPTH) clips[++depth] = clip;
+      else overflow++;
+      break;
+    case LL_RENDER_DATA_TAG_SCISSOR_END:
+      if (overflow > 0) overflow--;
+      else if (depth > 0) depth--;
+      break;
+    }
+  }
+}
+
+// public functions ============================================================
+
+ll_Size ll_soft_measure_text(const char* text, uint16_t letter_spacing) {
+  // the spacing is an ll_TextConfig letter spacing, which can be negative
+  int64_t width = (int64_t)strlen(text) * (LL_SOFT_GLYPH_WIDTH + (int16_t)letter_spacing);
+  return (ll_Size){.width = width > 0 ? (uint32_t)width : 0, .height = LL_SOFT_GLYPH_HEIGHT};
+}
+
+ll_Size ll_soft_measure_glyphs(const char* text, uint16_t letter_spacing, int32_t* glyph_x) {
+  int32_t advance = LL_SOFT_GLYPH_WIDTH + (int16_t)letter_spacing;
+  uint32_t length = 0;
+  for (; text[length] != '\0'; length++) {
+    if (glyph_x != NULL) glyph_x[length] = (int32_t)length * advance;
+  }
+  int64_t width = (int64_t)length * advance;
+  return (ll_Size){.width = width > 0 ? (uint32_t)width : 0, .height = LL_SOFT_GLYPH_HEIGHT};
+}
+
+ll_Size ll_soft_measure_image(LL_IMAGE_TYPE* image) {
+  const ll_SoftImage* soft = (const ll_SoftImage*)image;
+  return (ll_Size){.width = soft->width, .height = soft->height};
+}
+
+void ll_soft_clear(ll_SoftFramebuffer* fb, uint32_t color) {
+  for (uint32_t y = 0; y < fb->height; y++) {
+    char* row = (char*)fb->pixels + (size_t)y * fb->stride;
+    if (fb->format == LL_SOFT_FORMAT_RGBA8888) {
+      for (uint32_t x = 0; x < fb->width; x++) ((uint32_t*)row)[x] = color;
+    } else {
+      uint16_t pixel = ll__soft_to_rgb565(color);
+      for (uint32_t x = 0; x < fb->width; x++) ((uint16_t*)row)[x] = pixel;
+    }
+  }
+}
+
+void ll_soft_render(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, uint32_t text_color) {
+  ll__soft_render(fb, cmds, NULL, cmds.length, (ll__SoftRect){0, 0, fb->width, fb->height}, text_color);
+}
+
+void ll_soft_render_tile(ll_SoftFramebuffer* fb, ll_RenderCommandArray cmds, const ll_TileBins* bins, uint32_t tile,
+                         uint32_t text_color) {
+  ll__SoftRect clip = ll__soft_intersect(ll__soft_rect(ll_tile_bounds(bins, tile)),
+                                         (ll__SoftRect){0, 0, fb->width, fb->height});
+  uint32_t start = bins->offsets[tile];
+  ll__soft_render(fb, cmds, bins->indices + start, bins->offsets[tile + 1] - start, clip, text_color);
+}
+
+uint64_t ll_soft_text_cache_size(ll_Size atlas_size, uint32_t max_runs) {
+  uint64_t table_size = 1;
+  while (table_size < 2 * (uint64_t)max_runs) table_size <<= 1;
+  return LL__ARENA_FOOTPRINT(ll_SoftTextCache, 1)
+       + LL__ARENA_FOOTPRINT(uint32_t, (uint64_t)atlas_size.width * atlas_size.height)
+       + LL__ARENA_FOOTPRINT(ll__SoftRun, table_size);
+}
+
+ll_SoftTextCache* ll_soft_text_cache_init(char* mem, size_t capacity, ll_Size atlas_size, uint32_t max_runs) {
+  ll__Arena arena = {.capacity = capacity, .mem = mem};
+  uint32_t table_size = 1;
+  while (table_size < 2 * (uint64_t)max_runs) table_size <<= 1;
+  if (max_runs == 0 || table_size < max_runs) return NULL;
+  ll_SoftTextCache* cache = LL__ARENA_ALLOC(&arena, ll_SoftTextCache, 1);
+  uint32_t* atlas = LL__ARENA_ALLOC(&arena, uint32_t, (uint64_t)atlas_size.width * atlas_size.height);
+  ll__SoftRun* runs = LL__ARENA_ALLOC(&arena, ll__SoftRun, table_size);
+  if (cache == NULL || atlas == NULL || runs == NULL) return NULL;
+  *cache = (ll_SoftTextCache){
+      .atlas = atlas,
+      .atlas_size = atlas_size,
+      .runs = runs,
+      .run_mask = table_size - 1,
+      .max_runs = max_runs,
+  };
+  for (uint32_t i = 0; i < table_size; i++) runs[i].key = 0;
+  return cache;
+}
+
+void ll_soft_set_text_cache(ll_SoftTextCache* cache) {
+  ll__soft_text_cache = cache;
+}
+
+void ll_soft_cache_text(ll_RenderCommandArray cmds, uint32_t text_color) {
+  if (ll__soft_text_cache == NULL) return;
+  for (uint32_t i = 0; i < cmds.length; i++) {
+    const ll_RenderCommand* cmd = &cmds.internalArray[i];
+    if (cmd->tag != LL_RENDER_DATA_TAG_TEXT) continue;
+    ll__soft_find_run(ll__soft_text_cache, &cmd->render_data.text_render_data, text_color, true);
+  }
+}
+
+ll_CacheStats ll_soft_text_cache_stats(const ll_SoftTextCache* cache) {
+  return cache->stats;
+}
+
+bool ll_soft_set_isa(ll_SoftIsa isa) {
+  if (ll__soft_kernels_for(isa) == NULL) return false;
+  ll__soft_isa = isa;
+  return true;
+}
+
+ll_SoftIsa ll_soft_isa(void) {
+  if (ll__soft_isa != LL_SOFT_ISA_AUTO) return ll__soft_isa;
+  // the instruction sets are listed from least to most capable
+  for (ll_SoftIsa best = LL_SOFT_ISA_AVX2; best > LL_SOFT_ISA_SCALAR; best--) {
+    if (ll__soft_kernels_for(best) != NULL) return best;
+  }
+  return LL_SOFT_ISA_SCALAR;
+}